@@ -1,716 +1,5608 @@
-/*
-This is a plugin which allows items or units that fall on top of minecarts to be loaded into the minecart.
-*/
-
-#include "Core.h"
-#include "Console.h"
-#include "Export.h"
-#include "PluginManager.h"
-#include "VTableInterpose.h"
-#include "MiscUtils.h"
-
-#include <vector>
-#include <set>
-#include <algorithm>
-#include <fstream>
-#include <cmath>
-
-#include "df/world.h"
-#include "df/vehicle.h"
-#include "df/map_block.h"
-#include "df/general_ref.h"
-#include "df/general_ref_contains_itemst.h"
-#include "df/general_ref_contained_in_itemst.h"
-#include "df/general_ref_projectile.h"
-#include "df/general_ref_unit_riderst.h"
-#include "df/item.h"
-#include "df/item_toolst.h"
-#include "df/itemdef_toolst.h"
-#include "df/unit.h"
-
-#include "modules/MapCache.h"
-#include "modules/Items.h"
-#include "modules/Units.h"
-
-using namespace DFHack;
-
-
-
-// DFHack plugin preamble
-
-DFHACK_PLUGIN("minecart_fall_loading");
-DFHACK_PLUGIN_IS_ENABLED(active);
-REQUIRE_GLOBAL(world);
-
-
-
-// Debugging macros
-
-#define _DEBUG__MINECART_FALL_LOADING_
-
-#ifdef _DEBUG__MINECART_FALL_LOADING_
-	// logfile appears in root folder of DF directory
-	std::ofstream logfile("minecart_fall_loading_log.txt");
-
-	// DEBUG_PRINTLN: print the line of text on a line to the logfile
-	#define DEBUG_PRINTLN(text)      ; logfile << (text) << std::endl;
-	// DEBUG_PRINTLN_EXPR: print the text of an expression followed by its value on a line to the logfile
-	#define DEBUG_PRINTLN_EXPR(expr) ; logfile << (#expr) << ": " << (expr) << std::endl;
-#else
-	// null the debug macros if debugging turned off
-	#define DEBUG_PRINTLN(text)      ;
-    #define DEBUG_PRINTLN_EXPR(expr) ;
-#endif
-
-
-
-// Convenience functions for printing things to text output streams; primarily for debugging
-
-std::ostream& operator<<(std::ostream& o_st, df::coord pos) {
-	// Print df::coord <pos> to text output stream <o_st>
-	o_st << "(" << pos.x << ", " << pos.y << ", " << pos.z << ")";
-	return o_st;
-}
-
-template <typename... targs>
-std::ostream& operator<<(std::ostream& o_st, const std::set<targs...>& s) {
-	// Print the contents of set <s> to text output stream <o_st> a la Python format
-	o_st << "{";
-	int i = 0;
-	for (std::set<targs...>::const_iterator iter = s.cbegin(); iter != s.cend(); ++iter, ++i) {
-		o_st << *iter;
-		if (i != s.size() - 1) {
-			o_st << ", ";
-		}
-	}
-	o_st << "}";
-	return o_st;
-}
-
-
-
-// general class wrapping things that can be loaded into minecarts; currently items and units
-// this is defined later
-class Loadable;
-
-struct minecart_info {
-	// struct containing info about a minecart for the purposes of this plugin
-	
-	df::vehicle* minecart;
-	df::item* minecart_item;
-	
-	// pos: last recorded position
-	df::coord pos;
-	// next_pos: last recorded predicted next position
-	df::coord next_pos; 
-	
-	// above_pos: last recorded set of loadables in tile above this->pos
-	std::set<Loadable*> above_pos;
-	// above_next_pos: last recorded set of loadables in tile above this->next_pos
-	std::set<Loadable*> above_next_pos;
-};
-
-typedef df::vehicle::key_field_type minecart_id_t;
-
-// minecarts: the info records for all minecarts being tracked
-std::map<minecart_id_t, minecart_info*> minecarts;
-typedef decltype(minecarts)::iterator minecarts_iter_t;
-
-df::item* get_minecart_item(df::vehicle* minecart) {
-	// get the item associated with minecart <minecart>
-	return df::item::find(minecart->item_id);
-}
-
-df::map_block* get_map_block(df::coord pos) {
-	// get the map_block in which coord <pos> is located
-	return world->map.block_index[pos.x/16][pos.y/16][pos.z];
-}
-
-std::set<df::item*> get_items_at(df::coord pos) {
-	// get the set of items at coord <pos>	
-	std::set<df::item*> out;
-	
-	// loop through all items
-	// TODO: more efficient implementation?
-	// NOTE: item is not necessarily recorded in corresponding map_block
-	for (df::item* item : world->items.all) {
-		if (Items::getPosition(item) == pos) {
-			out.insert(item);
-		}
-	}
-	
-	return out;
-}
-
-std::set<df::unit*> get_units_at(df::coord pos) {
-	// get the set of units at coord <pos>
-	std::set<df::unit*> out;
-	
-	// loop through all active units
-	for (df::unit* unit : world->units.active) {
-		if (unit->pos == pos) {
-			out.insert(unit);
-		}
-	}
-	
-	return out;
-}
-
-int32_t get_item_load_capacity(df::item* item) {
-	// get the container capacity of item <item>
-	DEBUG_PRINTLN_EXPR(item->_identity.getFullName());
-	
-	// only df::item_toolst instances have an associated container capacity, I think
-	df::item_toolst* item_as_tool = virtual_cast<df::item_toolst>(item);
-	// if item is not a df::item_toolst
-	if (item_as_tool == nullptr) {
-		// item is not a container, so return 0
-		return 0;
-	}
-	df::itemdef_toolst* tool_def = item_as_tool->subtype;
-	return tool_def->container_capacity;
-}
-
-int32_t get_item_loaded_volume(df::item* item) {
-	// get the total volume of all objects inside item <item>
-	std::vector<df::item*> contained_items;
-	Items::getContainedItems(item, &contained_items);
-	int32_t out = 0;
-	for (df::item* item : contained_items) {
-		out += item->getVolume();
-	}
-	return out;
-}
-
-bool can_item_fit(df::vehicle* minecart, df::item* check_fit) {
-	// returns whether item <check_fit> can go inside minecart <minecart> without exceeding <minecart>'s capacity
-	df::item* minecart_item = get_minecart_item(minecart);
-	int32_t load_capacity = get_item_load_capacity(minecart_item);
-	int32_t loaded_volume = get_item_loaded_volume(minecart_item);
-	int32_t check_fit_volume = check_fit->getVolume();
-	DEBUG_PRINTLN_EXPR(load_capacity);
-	DEBUG_PRINTLN_EXPR(loaded_volume);
-	DEBUG_PRINTLN_EXPR(check_fit_volume);
-	return loaded_volume + check_fit_volume <= load_capacity;
-}
-
-bool can_unit_fit(df::vehicle* minecart, df::unit* check_fit) {
-	// returns whether unit <check_fit> can go inside minecart <minecart>
-	// currently this is whether there is not already a unit inside <minecart>
-	return !(get_minecart_item(minecart))->flags2.bits.has_rider;
-}
-
-void make_not_projectile(df::item* item) {
-	// makes item <item>, which must currently be a projectile, into not a projectile and puts it on the ground
-	DEBUG_PRINTLN("make_not_projectile");
-	DEBUG_PRINTLN_EXPR(item->id);
-	
-	// proj_ref: the stored general_ref of item to a df::projectile object
-	df::general_ref_projectile* proj_ref;
-	// proj_ref_index: the index of proj_ref in item's container of general_refs
-	unsigned int proj_ref_index;
-	
-	for (unsigned int i = 0; i != item->general_refs.size(); ++i) {
-		df::general_ref* ref = item->general_refs[i];
-		if (ref->getType() == df::general_ref_type::PROJECTILE) {
-			proj_ref = (df::general_ref_projectile*)ref;
-			proj_ref_index = i;
-			break;
-		}
-	}
-	
-	DEBUG_PRINTLN_EXPR(proj_ref);
-	DEBUG_PRINTLN_EXPR(proj_ref_index);
-	
-	// proj_id: the id of item's associated projectile object
-	int32_t proj_id = proj_ref->projectile_id;
-	DEBUG_PRINTLN_EXPR(proj_id);
-	// proj: item's associated projectile object
-	df::projectile* proj;
-	// link: the linked list link which holds proj
-	df::proj_list_link* link = &world->proj_list;
-	DEBUG_PRINTLN_EXPR(link);
-	DEBUG_PRINTLN_EXPR(link->item);
-	DEBUG_PRINTLN_EXPR(link->prev);
-	DEBUG_PRINTLN_EXPR(link->next);
-	
-	// linear search for proj
-	while (link->item == nullptr || link->item->id != proj_id) {
-		DEBUG_PRINTLN_EXPR(link->item);
-		//DEBUG_PRINTLN_EXPR(link->item->id);
-		link = link->next;
-	}
-	
-	DEBUG_PRINTLN("finished looking for link");
-	
-	proj = link->item;
-	
-	// cut link out of the linked list of which it is part, essentially removing proj from the list of projectiles
-	if (link->prev != nullptr) {
-		link->prev->next = link->next;
-	}
-	if (link->next != nullptr) {
-		link->next->prev = link->prev;
-	}
-	
-	DEBUG_PRINTLN("finished relinking linked list");
-	
-	delete link;
-	
-	DEBUG_PRINTLN("finished deleting link");
-	
-	// delete proj as void* to avoid calling destructor, which destructor seems to cause a crash
-	// TODO: possibly bad? fix?
-	delete (void*)proj;
-	
-	DEBUG_PRINTLN("finished deleting proj");
-	
-	// erase general_ref to projectile object from vector of general_refs
-	vector_erase_at(item->general_refs, proj_ref_index);
-	
-	DEBUG_PRINTLN("finished erasing proj_ref");
-	
-	item->flags.bits.on_ground = true;
-	
-	DEBUG_PRINTLN("finished setting on_ground flag to true");
-	
-	MapExtras::MapCache mc;
-	
-	DEBUG_PRINTLN("finished creating MapCache object");
-	
-	mc.addItemOnGround(item);
-	
-	DEBUG_PRINTLN("finished adding item on ground");
-}
-
-void load_minecart_with_item(df::vehicle* minecart, df::item* item) {
-	// load minecart <minecart> with item <item>
-	DEBUG_PRINTLN("load_minecart_with_item");
-	
-	// shelved_refs: general_refs of <item> that are forbidden by Items::moveToContainer
-	// these are removed before the call to Items::moveToContainer and restored after
-	// map: index of general_ref -> general_ref itself
-	std::map<size_t, df::general_ref*> shelved_refs;
-	
-	bool is_projectile = false;
-	
-	for (size_t i = 0; i != item->general_refs.size(); ++i) {
-		df::general_ref* ref = item->general_refs[i];
-		
-        switch (ref->getType())
-        {
-			case general_ref_type::PROJECTILE:
-				// general_refs of PROJECTILE type are not shelved
-				is_projectile = true;
-				break;
-			case general_ref_type::BUILDING_HOLDER:
-			case general_ref_type::BUILDING_CAGED:
-			case general_ref_type::BUILDING_TRIGGER:
-			case general_ref_type::BUILDING_TRIGGERTARGET:
-			case general_ref_type::BUILDING_CIVZONE_ASSIGNED:
-				shelved_refs.insert(std::make_pair(i, ref));
-				break;
-			default:
-				break;
-        }
-    }
-	
-	DEBUG_PRINTLN("finished shelvign general_refs");
-	DEBUG_PRINTLN_EXPR(is_projectile);
-	
-	// if item is a projectile, make it not a projectile and put it on the ground
-	// happens in the majority of cases where an item falls from above
-	// this is required to move it into a container, like a minecart
-	if (is_projectile) {
-		make_not_projectile(item);
-	}
-	
-	for (auto pr : shelved_refs) {
-		DEBUG_PRINTLN(pr.first);
-		DEBUG_PRINTLN(pr.second->getType());
-	}
-	
-	DEBUG_PRINTLN("finished printing shelved_refs");
-	
-	for (auto pr : shelved_refs) {
-		vector_erase_at(item->general_refs, pr.first);
-	}
-	
-	DEBUG_PRINTLN("finished removing shelved_refs");
-	
-	MapExtras::MapCache mc;
-	bool did_succeed = Items::moveToContainer(mc, item, get_minecart_item(minecart));
-	DEBUG_PRINTLN_EXPR(did_succeed);
-	
-	// restoration of shelved_refs
-	for (auto pr : shelved_refs) {
-		item->general_refs.push_back(pr.second);
-	}
-	
-	DEBUG_PRINTLN("finished putting back shelved_refs");
-}
-
-void load_minecart_with_unit(df::vehicle* minecart, df::unit* unit) {
-	// load minecart <minecart> with unit <unit>
-	DEBUG_PRINTLN("load_minecart_with_unit");
-	df::item* minecart_item = get_minecart_item(minecart);
-	
-	// change minecart
-	auto gen_ref = df::allocate<df::general_ref_unit_riderst>();
-	gen_ref->unit_id = unit->id;
-	minecart_item->general_refs.push_back(gen_ref);
-	minecart_item->flags2.bits.has_rider = true;
-	
-	// change unit
-	unit->mount_type = 0;
-	unit->riding_item_id = minecart_item->id;
-	unit->flags1.bits.rider = true;
-	//unit->flags3.bits.exit_vehicle1 = true;
-}
-
-int div_floor(int dividend, int divisor) {
-	// returns floor(dividend/divisor)
-	// (true floor, not rounding towards zero)
-	return (dividend >= 0) ? (dividend / divisor) : (dividend / divisor - 1);
-}
-
-df::coord get_next_pos(df::vehicle* minecart, df::coord current_pos) {
-	// returns the predicted next position of minecart <minecart> (in one tick)
-	// <current_pos> is current position of the minecart
-	return current_pos + df::coord(
-		div_floor(minecart->offset_x + minecart->speed_x + 50000, 100000),
-		div_floor(minecart->offset_y + minecart->speed_y + 50000, 100000),
-		div_floor(minecart->offset_z + minecart->speed_z + 50000, 100000)
-	);
-}
-
-
-
-class Loadable {
-	// general class wrapping things that can be loaded into minecarts; currently items and units
-	// abstract, subclassed to provide implementation for each specific case
-	public:
-		// constructor
-		Loadable();
-		virtual ~Loadable();
-		
-		// returns position of this in active map
-		virtual df::coord pos() const = 0;
-		// returns whether this can fit into given vehicle
-		virtual bool can_fit(df::vehicle*) const = 0;
-		// loads this into given vehicle
-		virtual void load(df::vehicle*) = 0;
-};
-
-class ItemLoadable : public Loadable {
-	// Loadable that wraps items
-	private:
-		df::item* contents;
-	public:
-		ItemLoadable(df::item*);
-		
-		virtual df::coord pos() const;
-		virtual bool can_fit(df::vehicle*) const;
-		virtual void load(df::vehicle*);
-};
-
-class UnitLoadable : public Loadable {
-	// Loadable that wraps units
-	private:
-		df::unit* contents;
-	public:
-		UnitLoadable(df::unit*);
-		
-		virtual df::coord pos() const;
-		virtual bool can_fit(df::vehicle*) const;
-		virtual void load(df::vehicle*);
-};
-
-Loadable::Loadable() {}
-
-Loadable::~Loadable() {}
-
-// implementation functions of Loadable subclasses delegate to global functions
-
-ItemLoadable::ItemLoadable(df::item* i_contents)
-  : Loadable(),
-    contents(i_contents)
-{}
-
-df::coord ItemLoadable::pos() const {
-	return Items::getPosition(contents);
-}
-
-bool ItemLoadable::can_fit(df::vehicle* minecart) const {
-	return can_item_fit(minecart, contents);
-}
-
-void ItemLoadable::load(df::vehicle* minecart) {
-	load_minecart_with_item(minecart, contents);
-}
-
-UnitLoadable::UnitLoadable(df::unit* i_contents)
-  : Loadable(),
-    contents(i_contents)
-{}
-
-df::coord UnitLoadable::pos() const {
-	return Units::getPosition(contents);
-}
-
-bool UnitLoadable::can_fit(df::vehicle* minecart) const {
-	return can_unit_fit(minecart, contents);
-}
-
-void UnitLoadable::load(df::vehicle* minecart) {
-	load_minecart_with_unit(minecart, contents);
-}
-
-
-
-std::set<Loadable*> get_loadables_at(df::coord pos) {
-	// returns the set of all loadables at position <pos>
-	
-	std::set<Loadable*> out;
-	std::set<df::item*> item_set = get_items_at(pos);
-	std::set<df::unit*> unit_set = get_units_at(pos);
-	
-	// wrap and insert each item
-	std::transform(
-		item_set.begin(),
-		item_set.end(),
-		std::inserter(out, out.begin()),
-		[](df::item* item) -> Loadable* { return new ItemLoadable(item); }
-	);
-	// wrap and insert each unit
-	std::transform(
-		unit_set.begin(),
-		unit_set.end(),
-		std::inserter(out, out.begin()),
-		[](df::unit* unit) -> Loadable* { return new UnitLoadable(unit); }
-	);
-	return out;
-}
-
-minecart_info* create_new_minecart_info(df::vehicle* minecart) {
-	// returns a pointer to a new info record for minecart <minecart>
-	// will be properly initialized later in the update, during the call to update_minecart_info
-	minecart_info* out = new minecart_info;
-	out->minecart = minecart;
-	out->minecart_item = get_minecart_item(minecart);
-	out->pos = df::coord();
-	out->next_pos = df::coord();
-	out->above_pos = {};
-	out->above_next_pos = {};
-	return out;
-}
-
-
-
-// Main three update functions:
-// * update_minecart_list
-// * perform_minecart_loading
-// * update_minecart_info
-
-void update_minecart_list() {
-	// updates the list of currently tracked minecarts:
-	// * removes no longer existing minecarts
-	// * begins tracking new, previously untracked minecarts
-	DEBUG_PRINTLN("update_minecart_list");
-	
-	std::vector<minecarts_iter_t> to_remove;
-	for (auto iter = minecarts.begin(); iter != minecarts.end(); ++iter) {
-		// if id is no longer found
-		if (df::vehicle::find(iter->first) == nullptr) {
-			to_remove.push_back(iter);
-		}
-	}
-	
-	DEBUG_PRINTLN_EXPR(to_remove.size());
-	
-	for (auto iter : to_remove) {
-		delete iter->second;
-		minecarts.erase(iter);
-	}
-	
-	unsigned int num_inserted = 0;
-	for (df::vehicle* v : world->vehicles.all) {
-		// this call will not perform an insertion if an equivalent key already exists
-		auto pr = minecarts.insert(std::make_pair(
-			v->id,
-			create_new_minecart_info(v)
-		));
-		// pr.second is true iff an insertion was made
-		if (pr.second) {
-			++num_inserted;
-		}
-	}
-	
-	DEBUG_PRINTLN_EXPR(num_inserted);
-}
-
-void perform_minecart_loading() {
-	// loads any items that should be loaded into minecarts because:
-	// * they have fallen from above
-	// * they fit in the minecart
-	DEBUG_PRINTLN("perform_minecart_loading");
-	
-	for (auto pr : minecarts) {
-		minecart_id_t id = pr.first;
-		minecart_info* info = pr.second;
-		
-		DEBUG_PRINTLN("LOOP");
-		DEBUG_PRINTLN_EXPR(id);
-		
-		df::vehicle* minecart = info->minecart;
-		df::item* minecart_item = info->minecart_item;      
-		df::coord current_pos = Items::getPosition(minecart_item);
-		
-		DEBUG_PRINTLN_EXPR(current_pos);
-		
-		// above_set: the set of loadables that was *last recorded* being above the minecart's *current* position
-		// this is above_pos if the minecart hasn't moved since the last update, and above_next_pos if it has moved
-		std::set<Loadable*>& above_set = (info->pos == current_pos) ? info->above_pos : info->above_next_pos;
-		
-		DEBUG_PRINTLN_EXPR(above_set);
-		
-		if (above_set.size() != 0) {
-			DEBUG_PRINTLN("perform_minecart_loading: minecart INTEREST 1");
-		}
-		
-		for (Loadable* loadable : above_set) {
-			DEBUG_PRINTLN_EXPR(loadable);
-			// if item has moved onto the minecart's current position since the last update
-			if (loadable->pos() == current_pos) {
-				DEBUG_PRINTLN("loadable fell onto minecart");
-				// if the item can fit in the minecart
-				if (loadable->can_fit(minecart)) {
-					DEBUG_PRINTLN("loadable can fit");
-					DEBUG_PRINTLN("loadable to be loaded");
-					// load the minecart with the item
-					loadable->load(minecart);
-				}
-			}
-		}
-	}
-}
-
-template <typename ContainerT>
-void delete_each_of(ContainerT& container) {
-	// deletes each pointer in container <container>, then clears it
-	// <container> of course must be of dynamically allocated pointers
-	std::for_each(
-		container.begin(),
-		container.end(),
-		[](ContainerT::value_type ptr) { delete ptr; }
-	);
-	container.clear();
-}
-
-void update_minecart_info() {
-	// updates the info recorded for each minecart being tracked
-	DEBUG_PRINTLN("update_minecart_info");
-	
-	for (auto pr : minecarts) {
-		minecart_id_t id = pr.first;
-		minecart_info* info = pr.second;
-		
-		DEBUG_PRINTLN_EXPR(id);
-		
-		df::vehicle* minecart = df::vehicle::find(id);
-		df::item* minecart_item = get_minecart_item(minecart);
-		df::coord current_pos = Items::getPosition(minecart_item);
-		
-		DEBUG_PRINTLN_EXPR(current_pos);
-		
-		info->pos = current_pos;
-		info->next_pos = get_next_pos(minecart, current_pos);
-		
-		DEBUG_PRINTLN_EXPR(info->next_pos);
-		
-		delete_each_of(info->above_pos);
-		delete_each_of(info->above_next_pos);
-		
-		info->above_pos = get_loadables_at(info->pos + df::coord(0, 0, 1));
-		DEBUG_PRINTLN_EXPR(info->above_pos);
-		info->above_next_pos = get_loadables_at(info->next_pos + df::coord(0, 0, 1));
-		DEBUG_PRINTLN_EXPR(info->above_next_pos);
-		
-		if (info->above_pos.size() != 0) {
-			DEBUG_PRINTLN("info->above_pos nonempty");
-		}
-		if (info->above_next_pos.size() != 0) {
-			DEBUG_PRINTLN("info->above_next_pos nonempty");
-		}
-	}
-}
-
-// counter: counter to next update
-unsigned int counter;
-
-DFhackCExport command_result plugin_init(color_ostream& out, std::vector<PluginCommand>& commands) {
-	DEBUG_PRINTLN("plugin_init");
-	CoreSuspender suspend;
-	counter = 1;
-	// not active until world is loaded
-	active = false;
-	DEBUG_PRINTLN("plugin_init: counter = 0;");
-	return CR_OK;
-}
-
-DFhackCExport command_result plugin_onupdate(color_ostream& out) {
-	if (!active) {
-		return CR_OK;
-	}
-	
-	DEBUG_PRINTLN("plugin_onupdate");
-	
-	CoreSuspender suspend;
-	
-	// TICKS: number of ticks between updates when active
-	static const unsigned int TICKS = 1;
-	
-	// if the counter has loop around to zero
-	if (counter == 0) {
-		DEBUG_PRINTLN("plugin_onupdate: counter == 0");
-		update_minecart_list();
-		perform_minecart_loading();
-		update_minecart_info();
-	}
-	
-	// update counter
-	++counter;
-	counter %= TICKS;
-	
-	DEBUG_PRINTLN("plugin_onupdate: update counter");
-	
-	return CR_OK;
-}
-
-DFhackCExport command_result plugin_shutdown(color_ostream& out) {
-	DEBUG_PRINTLN("plugin_shutdown");
-	
-	CoreSuspender suspend;
-	
-	active = false;
-	return CR_OK;
-}
-
-DFhackCExport command_result plugin_onstatechange(color_ostream& out, state_change_event event) {
-	DEBUG_PRINTLN("plugin_onstatechange");
-	
-	switch (event) {
-		case SC_MAP_LOADED:
-			// world is loaded
-			// become active
-			active = true;
-			break;
-		case SC_MAP_UNLOADED:
-			// world is unloaded
-			// become inactive
-			active = false;
-			break;
-	}
-	
-	return CR_OK;
-}
+/*
+This is a plugin which allows items or units that fall on top of minecarts to be loaded into the minecart.
+*/
+
+#include "Core.h"
+#include "Console.h"
+#include "Export.h"
+#include "PluginManager.h"
+#include "VTableInterpose.h"
+#include "MiscUtils.h"
+#include "DataDefs.h"
+
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <functional>
+#include <algorithm>
+#include <fstream>
+#include <cmath>
+#include <cstdlib>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <type_traits>
+#include <mutex>
+#include <condition_variable>
+#include <climits>
+#include <bitset>
+#include <array>
+
+// the position snapshot kernel uses the widest vector instructions the plugin is built for
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MINECART_FALL_LOADING_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MINECART_FALL_LOADING_SSE2
+#endif
+
+#include "df/world.h"
+#include "df/vehicle.h"
+#include "df/map_block.h"
+#include "df/tile_occupancy.h"
+#include "df/general_ref.h"
+#include "df/general_ref_contains_itemst.h"
+#include "df/general_ref_contained_in_itemst.h"
+#include "df/general_ref_projectile.h"
+#include "df/general_ref_unit_riderst.h"
+#include "df/general_ref_unit_holderst.h"
+#include "df/item.h"
+#include "df/item_toolst.h"
+#include "df/itemdef_toolst.h"
+#include "df/unit.h"
+#include "df/unit_inventory_item.h"
+#include "df/proj_itemst.h"
+#include "df/proj_unitst.h"
+
+#include "modules/MapCache.h"
+#include "modules/Items.h"
+#include "modules/Units.h"
+#include "modules/Materials.h"
+#include "modules/World.h"
+
+using namespace DFHack;
+
+
+
+// DFHack plugin preamble
+
+DFHACK_PLUGIN("minecart_fall_loading");
+DFHACK_PLUGIN_IS_ENABLED(active);
+REQUIRE_GLOBAL(world);
+
+
+
+// Logging
+// The hot path only checks whether a level and category are enabled and, if so, copies a compact binary record into a
+// lock-free ring buffer. A background thread formats the records and writes them to the logfile in batches, so logging
+// never blocks the game. Levels and categories can be switched at runtime with the plugin's console command; arguments
+// to disabled log statements are not even evaluated.
+
+// logfile appears in root folder of DF directory
+const char* const LOGFILE_NAME = "minecart_fall_loading_log.txt";
+
+enum log_level_t {
+	LEVEL_OFF,
+	LEVEL_ERROR,
+	LEVEL_INFO,
+	LEVEL_DEBUG,
+	LEVEL_TRACE
+};
+
+enum log_category_t : uint32_t {
+	// CATEGORY_GENERAL: plugin lifecycle and commands
+	CATEGORY_GENERAL  = 1 << 0,
+	// CATEGORY_REGISTRY: tracking minecarts
+	CATEGORY_REGISTRY = 1 << 1,
+	// CATEGORY_WATCH: predicting paths and filling watched tiles
+	CATEGORY_WATCH    = 1 << 2,
+	// CATEGORY_LOADING: fit checks and loading
+	CATEGORY_LOADING  = 1 << 3,
+	// CATEGORY_SCHEDULE: sleeping and waking minecarts
+	CATEGORY_SCHEDULE = 1 << 4,
+	// CATEGORY_VERIFY: mismatches found by the verification mode
+	CATEGORY_VERIFY   = 1 << 5,
+	CATEGORY_ALL      = (1 << 6) - 1
+};
+
+// log_level: the most verbose level written
+std::atomic<int> log_level(LEVEL_INFO);
+// log_categories: bitmask of the categories written
+std::atomic<uint32_t> log_categories(CATEGORY_ALL);
+
+inline bool log_enabled(log_level_t level, log_category_t category) {
+	// returns whether log statements of level <level> and category <category> are written
+	return level <= log_level.load(std::memory_order_relaxed)
+		&& (log_categories.load(std::memory_order_relaxed) & category) != 0;
+}
+
+// LOG_MAX_ARGS: the most arguments a single log statement may have
+const size_t LOG_MAX_ARGS = 4;
+
+struct log_arg {
+	// a log statement argument, stored as a tagged integer so that records stay fixed-size
+	enum type_t : uint8_t {
+		INTEGER,
+		COORD
+	};
+	type_t type;
+	int64_t value;
+};
+
+struct log_record {
+	// a log statement as written by the hot path; formatted later by the writer thread
+	int32_t tick;
+	uint8_t level;
+	uint8_t category;
+	uint8_t arg_count;
+	// format: a string literal, in which each "{}" is replaced by the next argument
+	const char* format;
+	log_arg args[LOG_MAX_ARGS];
+};
+
+class log_ring {
+	// bounded lock-free multi-producer single-consumer queue of log records
+	// each slot carries a sequence number saying whether it is free for the producer or ready for the consumer
+	public:
+		// <capacity> must be a power of 2
+		explicit log_ring(size_t capacity);
+		
+		// adds <record>; returns false, dropping it, if the queue is full
+		bool push(const log_record& record);
+		// removes the oldest record into <record>; returns false if the queue is empty; must only be called by the consumer
+		bool pop(log_record& record);
+	private:
+		struct slot {
+			std::atomic<uint64_t> sequence;
+			log_record record;
+		};
+		
+		std::unique_ptr<slot[]> slots;
+		uint64_t mask;
+		std::atomic<uint64_t> enqueue_pos;
+		uint64_t dequeue_pos;
+};
+
+log_ring::log_ring(size_t capacity)
+  : slots(new slot[capacity]),
+    mask(capacity - 1),
+    enqueue_pos(0),
+    dequeue_pos(0)
+{
+	for (size_t i = 0; i != capacity; ++i) {
+		slots[i].sequence.store(i, std::memory_order_relaxed);
+	}
+}
+
+bool log_ring::push(const log_record& record) {
+	uint64_t pos = enqueue_pos.load(std::memory_order_relaxed);
+	slot* target;
+	for (;;) {
+		target = &slots[pos & mask];
+		uint64_t sequence = target->sequence.load(std::memory_order_acquire);
+		int64_t diff = int64_t(sequence) - int64_t(pos);
+		if (diff == 0) {
+			if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		} else if (diff < 0) {
+			return false;
+		} else {
+			pos = enqueue_pos.load(std::memory_order_relaxed);
+		}
+	}
+	target->record = record;
+	target->sequence.store(pos + 1, std::memory_order_release);
+	return true;
+}
+
+bool log_ring::pop(log_record& record) {
+	slot& target = slots[dequeue_pos & mask];
+	uint64_t sequence = target.sequence.load(std::memory_order_acquire);
+	if (int64_t(sequence) - int64_t(dequeue_pos + 1) < 0) {
+		return false;
+	}
+	record = target.record;
+	target.sequence.store(dequeue_pos + mask + 1, std::memory_order_release);
+	++dequeue_pos;
+	return true;
+}
+
+// log_queue: records waiting for the writer thread
+log_ring log_queue(1 << 14);
+// log_dropped: number of records dropped because log_queue was full
+std::atomic<uint64_t> log_dropped(0);
+
+inline log_arg make_log_arg(df::coord pos) {
+	return log_arg{log_arg::COORD, (int64_t(uint16_t(pos.x)) << 32) | (int64_t(uint16_t(pos.y)) << 16) | int64_t(uint16_t(pos.z))};
+}
+
+template <typename T>
+inline log_arg make_log_arg(T value) {
+	static_assert(std::is_integral<T>::value || std::is_enum<T>::value, "log arguments must be integers or coords");
+	return log_arg{log_arg::INTEGER, int64_t(value)};
+}
+
+template <typename... targs>
+void log_write(log_level_t level, log_category_t category, const char* format, targs... args) {
+	// queues a record of a log statement; call through the PLUGIN_LOG macro, which checks log_enabled first
+	static_assert(sizeof...(args) <= LOG_MAX_ARGS, "too many log arguments");
+	log_arg packed[] = { make_log_arg(args)..., log_arg() };
+	log_record record;
+	record.tick = (world != nullptr) ? world->frame_counter : 0;
+	record.level = uint8_t(level);
+	record.category = uint8_t(category);
+	record.arg_count = uint8_t(sizeof...(args));
+	record.format = format;
+	std::copy(packed, packed + sizeof...(args), record.args);
+	if (!log_queue.push(record)) {
+		log_dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+// PLUGIN_LOG: log a statement of level <level> and category <category>
+// the format is a string literal in which each "{}" is replaced by the next argument (integers or df::coords)
+#define PLUGIN_LOG(level, category, ...) \
+	do { \
+		if (log_enabled(level, category)) { \
+			log_write(level, category, __VA_ARGS__); \
+		} \
+	} while (false)
+
+// Convenience functions for printing things to text output streams; primarily for debugging
+
+std::ostream& operator<<(std::ostream& o_st, df::coord pos) {
+	// Print df::coord <pos> to text output stream <o_st>
+	o_st << "(" << pos.x << ", " << pos.y << ", " << pos.z << ")";
+	return o_st;
+}
+
+void format_log_record(std::ostream& o_st, const log_record& record) {
+	// Print log record <record> as a line of text to text output stream <o_st>
+	static const char* const LEVEL_NAMES[] = {"off", "error", "info", "debug", "trace"};
+	o_st << "[" << record.tick << "] " << LEVEL_NAMES[record.level] << ": ";
+	uint8_t next_arg = 0;
+	for (const char* c = record.format; *c != '\0'; ++c) {
+		if (c[0] == '{' && c[1] == '}' && next_arg != record.arg_count) {
+			const log_arg& arg = record.args[next_arg++];
+			if (arg.type == log_arg::COORD) {
+				o_st << df::coord(int16_t(arg.value >> 32), int16_t(arg.value >> 16), int16_t(arg.value));
+			} else {
+				o_st << arg.value;
+			}
+			++c;
+		} else {
+			o_st << *c;
+		}
+	}
+	o_st << '\n';
+}
+
+// log_writer: background thread formatting and writing queued records; runs between start_log_writer and stop_log_writer
+std::thread log_writer;
+std::atomic<bool> log_writer_running(false);
+
+void drain_log_queue(std::ofstream& logfile) {
+	// formats every queued record to <logfile>, then flushes it once
+	log_record record;
+	bool wrote = false;
+	while (log_queue.pop(record)) {
+		format_log_record(logfile, record);
+		wrote = true;
+	}
+	uint64_t dropped = log_dropped.exchange(0, std::memory_order_relaxed);
+	if (dropped != 0) {
+		logfile << "(" << dropped << " log records dropped)\n";
+		wrote = true;
+	}
+	if (wrote) {
+		logfile.flush();
+	}
+}
+
+void start_log_writer() {
+	// starts the background thread writing the logfile
+	if (log_writer_running.exchange(true)) {
+		return;
+	}
+	log_writer = std::thread([]() {
+		std::ofstream logfile(LOGFILE_NAME);
+		while (log_writer_running.load()) {
+			drain_log_queue(logfile);
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		drain_log_queue(logfile);
+	});
+}
+
+void stop_log_writer() {
+	// stops the background thread writing the logfile, after it has written everything queued
+	if (!log_writer_running.exchange(false)) {
+		return;
+	}
+	log_writer.join();
+}
+
+
+
+// Instrumentation
+// Each update phase and loading step is timed into a latency histogram, and the work done is counted, so that the cost of
+// the plugin on a live fort can be measured. Printed, reset and dumped as CSV with the plugin's "stats" console subcommand.
+
+enum phase_t {
+	// PHASE_UPDATE: a whole update, all phases together
+	PHASE_UPDATE,
+	PHASE_UPDATE_MINECART_LIST,
+	PHASE_PERFORM_MINECART_LOADING,
+	PHASE_UPDATE_MINECART_INFO,
+	PHASE_MAKE_NOT_PROJECTILE,
+	PHASE_MOVE_TO_CONTAINER,
+	// PHASE_WRITE_MAP_CACHE: writing back the map cache shared by an update's loads
+	PHASE_WRITE_MAP_CACHE,
+	// PHASE_PLAN_NEXT_UPDATE: planning the next update's paths on the planner thread, while the game runs; recorded by finish_plan
+	PHASE_PLAN_NEXT_UPDATE,
+	PHASE_COUNT
+};
+
+const char* const PHASE_NAMES[PHASE_COUNT] = {
+	"update",
+	"update_minecart_list",
+	"perform_minecart_loading",
+	"update_minecart_info",
+	"make_not_projectile",
+	"move_to_container",
+	"write_map_cache",
+	"plan_next_update"
+};
+
+enum counter_t {
+	COUNTER_UPDATES,
+	COUNTER_ITEMS_SCANNED,
+	COUNTER_UNITS_SCANNED,
+	// COUNTER_TILES_PREFILTERED: tiles above minecart paths left unwatched because their occupancy showed them empty
+	COUNTER_TILES_PREFILTERED,
+	// COUNTER_BLOCKS_REFRESHED, COUNTER_BLOCKS_REUSED: map_blocks holding watched tiles whose ground items were re-read,
+	// or taken from the previous update because the block had not changed, when tracking blocks
+	COUNTER_BLOCKS_REFRESHED,
+	COUNTER_BLOCKS_REUSED,
+	// COUNTER_CANDIDATES: loadables found on watched tiles
+	COUNTER_CANDIDATES,
+	// COUNTER_INCOMING_STAGED, COUNTER_INCOMING_LANDED: projectiles staged in the column above a path tile, and staged objects
+	// found landed on a minecart
+	COUNTER_INCOMING_STAGED,
+	COUNTER_INCOMING_LANDED,
+	// COUNTER_COLUMN_WAKES: sleeping minecarts woken by an object staged in the column above them
+	COUNTER_COLUMN_WAKES,
+	COUNTER_ITEMS_LOADED,
+	COUNTER_UNITS_LOADED,
+	// COUNTER_REJECTED_CAPACITY: items that landed on a minecart without room for them
+	COUNTER_REJECTED_CAPACITY,
+	// COUNTER_REJECTED_OCCUPIED: units that landed on a minecart which already had a rider
+	COUNTER_REJECTED_OCCUPIED,
+	// COUNTER_REJECTED_LOAD_FAILED: loadables that fit but which DF refused to move into the minecart
+	COUNTER_REJECTED_LOAD_FAILED,
+	// COUNTER_REJECTED_TIMING: loadables that landed on a tile the minecart crossed, but not while it was predicted to be there
+	COUNTER_REJECTED_TIMING,
+	// COUNTER_FILTERED: loadables that landed on a minecart but which its loading filter passed over
+	COUNTER_FILTERED,
+	// COUNTER_UNWANTED: loadables found on watched tiles that no awake minecart's filter could let be loaded, so not recorded
+	COUNTER_UNWANTED,
+	// COUNTER_LANDING_BATCHES: updates in which more than one item landed on a minecart, so they were chosen among together
+	COUNTER_LANDING_BATCHES,
+	// COUNTER_PLANS_KEPT, COUNTER_PLANS_MISSED: minecarts whose real path swept the tiles planned ahead for it, so was left
+	// watched, and which had no plan or swept other tiles, so were watched again
+	COUNTER_PLANS_KEPT,
+	COUNTER_PLANS_MISSED,
+	// COUNTER_PLANS_FOLLOWED: of the plans kept, those of minecarts found where and as planned, so given the planned path
+	// without advancing their own
+	COUNTER_PLANS_FOLLOWED,
+	// COUNTER_BUFFER_GROWTHS: growths of the plugin's own buffers reused from update to update; see buffer_growths
+	COUNTER_BUFFER_GROWTHS,
+	// COUNTER_VERIFY_MISMATCHES: watched tiles whose recorded contents differed from the reference scan, when verifying
+	COUNTER_VERIFY_MISMATCHES,
+	COUNTER_COUNT
+};
+
+const char* const COUNTER_NAMES[COUNTER_COUNT] = {
+	"updates",
+	"items_scanned",
+	"units_scanned",
+	"tiles_prefiltered",
+	"blocks_refreshed",
+	"blocks_reused",
+	"candidates",
+	"incoming_staged",
+	"incoming_landed",
+	"column_wakes",
+	"items_loaded",
+	"units_loaded",
+	"rejected_capacity",
+	"rejected_occupied",
+	"rejected_load_failed",
+	"rejected_timing",
+	"filtered",
+	"unwanted",
+	"landing_batches",
+	"plans_kept",
+	"plans_missed",
+	"plans_followed",
+	"buffer_growths",
+	"verify_mismatches"
+};
+
+struct latency_histogram {
+	// histogram of durations in power-of-2 nanosecond buckets: bucket b counts durations in [2^b, 2^(b+1)) ns
+	static const unsigned int BUCKETS = 40;
+	uint64_t buckets[BUCKETS];
+	uint64_t count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	
+	void record(uint64_t ns) {
+		unsigned int bucket = 0;
+		while (bucket + 1 < BUCKETS && (ns >> (bucket + 1)) != 0) {
+			++bucket;
+		}
+		++buckets[bucket];
+		++count;
+		total_ns += ns;
+		max_ns = std::max(max_ns, ns);
+	}
+	
+	uint64_t percentile_ns(double fraction) const {
+		// returns an upper bound on the duration below which <fraction> of the recorded durations fall
+		uint64_t threshold = uint64_t(std::ceil(fraction * count));
+		uint64_t seen = 0;
+		for (unsigned int bucket = 0; bucket != BUCKETS; ++bucket) {
+			seen += buckets[bucket];
+			if (seen >= threshold && seen != 0) {
+				return std::min(uint64_t(2) << bucket, max_ns);
+			}
+		}
+		return max_ns;
+	}
+};
+
+struct plugin_stats {
+	latency_histogram phases[PHASE_COUNT];
+	uint64_t counters[COUNTER_COUNT];
+	// max_buffer_growths_per_update: the most growths of the plugin's own buffers in a single update
+	uint64_t max_buffer_growths_per_update;
+};
+
+// stats: everything measured since the plugin was loaded or the stats were last reset
+plugin_stats stats = {};
+
+inline void count(counter_t counter, uint64_t amount = 1) {
+	// adds <amount> to counter <counter>
+	stats.counters[counter] += amount;
+}
+
+class phase_timer {
+	// times its own lifetime into the histogram of phase <phase>
+	public:
+		explicit phase_timer(phase_t i_phase)
+		  : phase(i_phase),
+		    start(std::chrono::steady_clock::now())
+		{}
+		
+		~phase_timer() {
+			auto elapsed = std::chrono::steady_clock::now() - start;
+			stats.phases[phase].record(uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+		}
+	private:
+		phase_t phase;
+		std::chrono::steady_clock::time_point start;
+};
+
+void print_stats(color_ostream& out) {
+	// prints stats to console <out>
+	out.print("%-26s %10s %12s %12s %12s %12s\n", "phase", "count", "mean (us)", "p50 (us)", "p99 (us)", "max (us)");
+	for (unsigned int phase = 0; phase != PHASE_COUNT; ++phase) {
+		const latency_histogram& histogram = stats.phases[phase];
+		double mean_ns = histogram.count ? double(histogram.total_ns) / histogram.count : 0.0;
+		out.print("%-26s %10llu %12.2f %12.2f %12.2f %12.2f\n",
+			PHASE_NAMES[phase],
+			(unsigned long long)histogram.count,
+			mean_ns / 1000.0,
+			histogram.percentile_ns(0.5) / 1000.0,
+			histogram.percentile_ns(0.99) / 1000.0,
+			histogram.max_ns / 1000.0
+		);
+	}
+	uint64_t updates = stats.counters[COUNTER_UPDATES];
+	for (unsigned int counter = 0; counter != COUNTER_COUNT; ++counter) {
+		out.print("%-26s %10llu (%.2f per update)\n",
+			COUNTER_NAMES[counter],
+			(unsigned long long)stats.counters[counter],
+			updates ? double(stats.counters[counter]) / updates : 0.0
+		);
+	}
+	out.print("%-26s %10llu\n", "max_buffer_growths_per_update", (unsigned long long)stats.max_buffer_growths_per_update);
+}
+
+bool write_stats_csv(const std::string& path) {
+	// writes stats to the file at <path> as CSV, one row per phase and then one row per counter; returns whether it succeeded
+	std::ofstream file(path);
+	if (!file) {
+		return false;
+	}
+	file << "kind,name,count,total_ns,mean_ns,p50_ns,p99_ns,max_ns";
+	for (unsigned int bucket = 0; bucket != latency_histogram::BUCKETS; ++bucket) {
+		file << ",bucket_" << bucket;
+	}
+	file << "\n";
+	for (unsigned int phase = 0; phase != PHASE_COUNT; ++phase) {
+		const latency_histogram& histogram = stats.phases[phase];
+		file << "phase," << PHASE_NAMES[phase] << "," << histogram.count << "," << histogram.total_ns << ","
+			<< (histogram.count ? histogram.total_ns / histogram.count : 0) << ","
+			<< histogram.percentile_ns(0.5) << "," << histogram.percentile_ns(0.99) << "," << histogram.max_ns;
+		for (unsigned int bucket = 0; bucket != latency_histogram::BUCKETS; ++bucket) {
+			file << "," << histogram.buckets[bucket];
+		}
+		file << "\n";
+	}
+	for (unsigned int counter = 0; counter != COUNTER_COUNT; ++counter) {
+		file << "counter," << COUNTER_NAMES[counter] << "," << stats.counters[counter] << "\n";
+	}
+	file << "counter,max_buffer_growths_per_update," << stats.max_buffer_growths_per_update << "\n";
+	return bool(file);
+}
+
+
+
+// Handles
+// DF objects kept from one update to the next are referred to by id, with a cached pointer stamped with the epoch of the vector
+// the object lives in. An epoch ends whenever objects of that type have been created or destroyed, which DF always does by
+// changing the size or the last id of the vector, since ids are never reused. Within an epoch the cached pointer is used as is;
+// after it, the object is looked up by id once, and comes back as nullptr if it has been destroyed. A handle also keeps the
+// world_generation it was made in, and always comes back as nullptr once that world has been unloaded, since the ids it held may
+// belong to other objects in the next world loaded.
+
+struct vector_epoch {
+	// the epoch of a vector of DF objects: <epoch> is incremented whenever <size> or <last_id> is found changed
+	size_t size;
+	int32_t last_id;
+	// epoch: never 0, so that a stamp of 0 is always out of date
+	uint32_t epoch;
+};
+
+// world_generation: incremented by forget_world whenever the world is unloaded
+uint32_t world_generation = 0;
+// item_epoch, unit_epoch: the epochs of world->items.all and world->units.all, as of the last refresh_handle_epochs
+vector_epoch item_epoch = {0, -1, 1};
+vector_epoch unit_epoch = {0, -1, 1};
+
+void end_epoch(vector_epoch& epoch) {
+	// ends <epoch>, so that every pointer cached during it is looked up again
+	if (++epoch.epoch == 0) {
+		epoch.epoch = 1;
+	}
+}
+
+template <typename T>
+void refresh_epoch(const std::vector<T*>& objects, vector_epoch& epoch) {
+	// ends the epoch of <objects> if objects have been created or destroyed since it began
+	int32_t last_id = objects.empty() ? -1 : objects.back()->id;
+	if (objects.size() != epoch.size || last_id != epoch.last_id) {
+		epoch.size = objects.size();
+		epoch.last_id = last_id;
+		end_epoch(epoch);
+	}
+}
+
+void refresh_handle_epochs() {
+	// brings the epochs up to date; called at the start of every update, since the game has run in between
+	refresh_epoch(world->items.all, item_epoch);
+	refresh_epoch(world->units.all, unit_epoch);
+}
+
+template <typename T>
+uint32_t current_epoch();
+
+template <>
+inline uint32_t current_epoch<df::item>() {
+	return item_epoch.epoch;
+}
+
+template <>
+inline uint32_t current_epoch<df::unit>() {
+	return unit_epoch.epoch;
+}
+
+template <typename T>
+T* resolve_handle(int32_t id, uint32_t generation, T*& cached, uint32_t& stamp) {
+	// returns the object of type T with id <id> in world generation <generation>: nullptr if that world has been unloaded,
+	// <cached> if <stamp> is the current epoch, or else looked up and cached
+	if (generation != world_generation) {
+		return nullptr;
+	}
+	uint32_t epoch = current_epoch<T>();
+	if (stamp != epoch) {
+		cached = id < 0 ? nullptr : T::find(id);
+		stamp = epoch;
+	}
+	return cached;
+}
+
+template <typename T>
+class handle {
+	// refers to a DF object of type T by id, resolving to it in O(1) while its epoch lasts
+	public:
+		handle()
+		  : id(-1),
+		    generation(world_generation),
+		    cached(nullptr),
+		    stamp(0)
+		{}
+		
+		explicit handle(T* object)
+		  : id(object != nullptr ? object->id : -1),
+		    generation(world_generation),
+		    cached(object),
+		    stamp(current_epoch<T>())
+		{}
+		
+		// returns the id of the object referred to; -1 for none
+		int32_t get_id() const {
+			return id;
+		}
+		
+		// returns the object referred to, or nullptr if it no longer exists
+		T* get() const {
+			return resolve_handle(id, generation, cached, stamp);
+		}
+	private:
+		int32_t id;
+		uint32_t generation;
+		mutable T* cached;
+		mutable uint32_t stamp;
+};
+
+
+
+// info record of a tracked minecart; defined below
+struct minecart_info;
+// compiled loading filter; defined below
+struct load_filter;
+
+class Loadable {
+	// handle to something that can be loaded into minecarts; currently items and units
+	// a small value tagged with the kind of object it wraps, so that loadables can be kept in flat arrays without allocation
+	// refers to the object by id, like a handle, so a loadable kept across updates never dereferences a destroyed object
+	public:
+		enum kind_t : uint8_t {
+			ITEM,
+			UNIT
+		};
+		
+		// constructors
+		Loadable();
+		explicit Loadable(df::item*);
+		explicit Loadable(df::unit*);
+		// refers to the object of kind <kind> with id <id>, without resolving it
+		Loadable(kind_t kind, int32_t id);
+		
+		// returns the kind of object this wraps
+		kind_t kind() const;
+		// returns the id of the wrapped object
+		int32_t id() const;
+		// returns the wrapped item, or nullptr if it no longer exists; this must wrap an item
+		df::item* item() const;
+		// returns the wrapped unit, or nullptr if it no longer exists; this must wrap a unit
+		df::unit* unit() const;
+		
+		// returns position of this in active map; an invalid coord if the object no longer exists
+		df::coord pos() const;
+		// returns whether the loading filter of given tracked minecart lets this be loaded into it
+		bool passes_filter(const minecart_info&) const;
+		// returns whether the filter of some awake minecart could let this be loaded, as gathered in wanted
+		bool is_wanted() const;
+		// returns whether this can fit into given tracked minecart
+		bool can_fit(const minecart_info&) const;
+		// loads this into given tracked minecart, or for an item queues it to be by commit_item_loads;
+		// returns whether it succeeded or was queued
+		bool load(minecart_info&) const;
+		
+		// loadables are equal if they wrap the same object; ordered by kind, then id
+		bool operator==(const Loadable&) const;
+		bool operator<(const Loadable&) const;
+	private:
+		kind_t contents_kind;
+		int32_t contents_id;
+		// cached, cached_stamp, generation: the handle of the wrapped object; see resolve_handle
+		mutable union {
+			df::item* item;
+			df::unit* unit;
+		} cached;
+		mutable uint32_t cached_stamp;
+		uint32_t generation;
+};
+
+// loadable_span: a run of loadables stored contiguously in loadable_arena
+struct loadable_span {
+	uint32_t first;
+	uint32_t count;
+};
+
+typedef df::vehicle::key_field_type minecart_id_t;
+
+// MAX_PATH_TILES: the most tiles of a minecart's predicted path that are watched
+const unsigned int MAX_PATH_TILES = 8;
+
+struct cart_motion {
+	// a minecart's offsets within its tile and its speed, copied out of its df::vehicle, so that paths are predicted from plain
+	// data, as they are on the planner thread
+	// offset_x, offset_y, offset_z: in 1/100000ths of a tile from the tile's centre
+	int32_t offset_x;
+	int32_t offset_y;
+	int32_t offset_z;
+	int32_t speed_x;
+	int32_t speed_y;
+	int32_t speed_z;
+};
+
+struct minecart_info {
+	// struct containing info about a minecart for the purposes of this plugin
+	
+	minecart_id_t id;
+	// minecart: refreshed from world->vehicles.all by every update_minecart_list
+	df::vehicle* minecart;
+	// minecart_item: the item of the minecart; resolved in O(1) while no items are created or destroyed
+	handle<df::item> minecart_item;
+	
+	// pos: last recorded position
+	df::coord pos;
+	// path: the distinct tiles the minecart is predicted to pass through, in order, starting with pos
+	// maintained incrementally by advance_path as the minecart moves along it
+	df::coord path[MAX_PATH_TILES];
+	// path_length: number of tiles in path; at least 1 once the minecart has been through update_minecart_info
+	unsigned int path_length;
+	// path_motion: the offsets within path[0] and the speed from which path was predicted
+	cart_motion path_motion;
+	// path_tick: world->frame_counter of the update path was predicted in
+	int32_t path_tick;
+	
+	// load_capacity: container capacity of minecart_item; fixed, so found once when tracking begins
+	int32_t load_capacity;
+	// loaded_volume: running total of the volume of the items inside minecart_item
+	// kept up to date by load_minecart_with_item, and recomputed by revalidate_loaded_volume when DF changes the contents
+	int32_t loaded_volume;
+	// contents_stamp: get_contents_stamp of minecart_item when loaded_volume was last made up to date
+	// it changes with which items are contained, even when as many are unloaded as loaded, so a mismatch means loaded_volume must be recomputed
+	uint64_t contents_stamp;
+	
+	// asleep: whether the minecart is stationary with nothing above it, and so neither watched nor loaded until woken
+	bool asleep;
+	// idle_updates: number of consecutive updates for which the minecart has been idle while awake
+	unsigned int idle_updates;
+	// activity_stamp: get_activity_stamp of the tile above pos when the minecart fell asleep
+	uint64_t activity_stamp;
+	
+	// above_path: last recorded loadables in the tile above each tile of this->path
+	// refers into loadable_arena, so stays valid until the next update_minecart_info
+	loadable_span above_path[MAX_PATH_TILES];
+	// incoming_path: last staged objects falling down the column above each tile of this->path, soonest to land first
+	// refers into incoming_arena, so stays valid until the next update_minecart_info
+	loadable_span incoming_path[MAX_PATH_TILES];
+	
+	// filter: the loading filter of the minecart, or nullptr to load anything that fits; brought up to date by refresh_filter
+	const load_filter* filter;
+	// filter_route, filter_generation: the route and filters_generation for which filter was last resolved
+	int32_t filter_route;
+	uint32_t filter_generation;
+};
+
+// minecarts: the info records for all minecarts being tracked, in ascending order of id like world->vehicles.all
+// stored densely by value, so that the update loops walk contiguous memory
+std::vector<minecart_info> minecarts;
+// minecarts_scratch: buffer into which update_minecart_list merges the next minecarts; swapped with it, so never reallocated
+std::vector<minecart_info> minecarts_scratch;
+// registry_generation: incremented whenever a record is added to or removed from minecarts, moving records to other slots
+// a slot remembered along with the generation at which it was found remains valid while the generation is unchanged
+uint32_t registry_generation = 0;
+
+minecart_info* find_minecart(minecart_id_t id) {
+	// returns the info record of the tracked minecart with id <id>, or nullptr if it is not tracked
+	// the pointer is invalidated when registry_generation changes
+	auto iter = std::lower_bound(
+		minecarts.begin(),
+		minecarts.end(),
+		id,
+		[](const minecart_info& info, minecart_id_t id) { return info.id < id; }
+	);
+	return (iter != minecarts.end() && iter->id == id) ? &*iter : nullptr;
+}
+
+df::item* get_minecart_item(df::vehicle* minecart) {
+	// get the item associated with minecart <minecart>
+	return df::item::find(minecart->item_id);
+}
+
+df::map_block* get_map_block(df::coord pos) {
+	// get the map_block in which coord <pos> is located, or nullptr if <pos> is outside the map
+	if (pos.x < 0 || pos.y < 0 || pos.z < 0 ||
+		pos.x/16 >= world->map.x_count_block || pos.y/16 >= world->map.y_count_block || pos.z >= world->map.z_count_block) {
+		return nullptr;
+	}
+	return world->map.block_index[pos.x/16][pos.y/16][pos.z];
+}
+
+df::coord get_block_coord(df::coord pos) {
+	// returns the coord of the map_block in which coord <pos> is located, in block units for x and y
+	return df::coord(pos.x / 16, pos.y / 16, pos.z);
+}
+
+// buffer_growths: number of times one of the plugin's own buffers reused from update to update has had to grow
+// stays constant in the steady state, where every such buffer already has the capacity it needs; this covers only the buffers
+// grown through push_back_counted, resize_counted and coord_table, not the containers of DF, MapCache or the loading functions
+// atomic, as the movement interposes and the planner may both grow buffers while the game runs
+std::atomic<uint64_t> buffer_growths(0);
+
+template <typename T>
+void push_back_counted(std::vector<T>& vec, const T& value) {
+	// appends <value> to <vec>, counting the growth in buffer_growths if <vec> has to grow
+	if (vec.size() == vec.capacity()) {
+		++buffer_growths;
+	}
+	vec.push_back(value);
+}
+
+template <typename T>
+void resize_counted(std::vector<T>& vec, size_t size) {
+	// resizes <vec> to <size>, counting the growth in buffer_growths if <vec> has to grow
+	// grows geometrically, as push_back does: resize alone only grows to the larger of <size> and twice the current size, so
+	// a buffer shrunk by its last update would otherwise grow a little at every new peak
+	if (size > vec.capacity()) {
+		++buffer_growths;
+		vec.reserve(std::max(size, 2 * vec.capacity()));
+	}
+	vec.resize(size);
+}
+
+class coord_table {
+	// open-addressing hash set of coords, which numbers its coords with consecutive slots in order of insertion
+	// clear is O(1) and capacity is kept, so a table reused from update to update stops allocating once it is big enough
+	// each coord counts the times it was inserted, and is only removed once released as many times
+	public:
+		// npos: slot returned for coords not in the table
+		static const uint32_t npos = ~uint32_t(0);
+		
+		coord_table();
+		
+		// removes every coord
+		void clear();
+		// adds coord <pos> if not already present, counts the insertion, and returns its slot
+		uint32_t insert(df::coord pos);
+		// uncounts one insertion of coord <pos>, if present, and removes it if none is left; the coord in the last slot
+		// then moves into its slot
+		void release(df::coord pos);
+		// returns the slot of coord <pos>, or npos if it is not present
+		uint32_t find(df::coord pos) const;
+		// returns the number of coords present; slots are 0 to size() - 1
+		uint32_t size() const;
+		// returns the coord in slot <slot>
+		df::coord at(uint32_t slot) const;
+	private:
+		struct bucket {
+			df::coord key;
+			// stamp: bucket is occupied iff stamp == generation
+			uint32_t stamp;
+			uint32_t slot;
+		};
+		
+		std::vector<bucket> buckets;
+		std::vector<df::coord> keys;
+		// insertions: slot -> the times its coord was inserted, less the times it was released
+		std::vector<uint32_t> insertions;
+		uint32_t generation;
+		
+		static uint32_t hash(df::coord pos);
+		// returns the index of the bucket of coord <pos>, or npos if it is not present
+		uint32_t find_bucket(df::coord pos) const;
+		// doubles the number of buckets and reinserts every coord
+		void grow();
+};
+
+coord_table::coord_table()
+  : buckets(16),
+    keys(),
+    generation(1)
+{
+	for (bucket& b : buckets) {
+		b.stamp = 0;
+	}
+}
+
+uint32_t coord_table::hash(df::coord pos) {
+	uint64_t packed = (uint64_t(uint16_t(pos.x)) << 32) | (uint64_t(uint16_t(pos.y)) << 16) | uint64_t(uint16_t(pos.z));
+	packed *= 0x9E3779B97F4A7C15ull;
+	return uint32_t(packed >> 32);
+}
+
+void coord_table::clear() {
+	keys.clear();
+	insertions.clear();
+	++generation;
+	// on the (very) rare wraparound, stale stamps could alias the new generation, so wipe them
+	if (generation == 0) {
+		for (bucket& b : buckets) {
+			b.stamp = 0;
+		}
+		generation = 1;
+	}
+}
+
+uint32_t coord_table::insert(df::coord pos) {
+	if ((keys.size() + 1) * 2 > buckets.size()) {
+		grow();
+	}
+	uint32_t mask = uint32_t(buckets.size() - 1);
+	for (uint32_t i = hash(pos) & mask; ; i = (i + 1) & mask) {
+		bucket& b = buckets[i];
+		if (b.stamp != generation) {
+			b.key = pos;
+			b.stamp = generation;
+			b.slot = uint32_t(keys.size());
+			push_back_counted(keys, pos);
+			push_back_counted(insertions, 1u);
+			return b.slot;
+		}
+		if (b.key == pos) {
+			++insertions[b.slot];
+			return b.slot;
+		}
+	}
+}
+
+void coord_table::release(df::coord pos) {
+	uint32_t i = find_bucket(pos);
+	if (i == npos) {
+		return;
+	}
+	uint32_t slot = buckets[i].slot;
+	if (--insertions[slot] != 0) {
+		return;
+	}
+	
+	// the buckets after the freed one are shifted back into it while that brings them no further from their own, so that
+	// lookups never stop short at the gap
+	uint32_t mask = uint32_t(buckets.size() - 1);
+	buckets[i].stamp = 0;
+	for (uint32_t j = (i + 1) & mask; buckets[j].stamp == generation; j = (j + 1) & mask) {
+		uint32_t home = hash(buckets[j].key) & mask;
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			buckets[i] = buckets[j];
+			buckets[j].stamp = 0;
+			i = j;
+		}
+	}
+	
+	uint32_t last = uint32_t(keys.size() - 1);
+	if (slot != last) {
+		keys[slot] = keys[last];
+		insertions[slot] = insertions[last];
+		buckets[find_bucket(keys[slot])].slot = slot;
+	}
+	keys.pop_back();
+	insertions.pop_back();
+}
+
+uint32_t coord_table::find_bucket(df::coord pos) const {
+	uint32_t mask = uint32_t(buckets.size() - 1);
+	for (uint32_t i = hash(pos) & mask; ; i = (i + 1) & mask) {
+		const bucket& b = buckets[i];
+		if (b.stamp != generation) {
+			return npos;
+		}
+		if (b.key == pos) {
+			return i;
+		}
+	}
+}
+
+uint32_t coord_table::find(df::coord pos) const {
+	uint32_t i = find_bucket(pos);
+	return i != npos ? buckets[i].slot : npos;
+}
+
+uint32_t coord_table::size() const {
+	return uint32_t(keys.size());
+}
+
+df::coord coord_table::at(uint32_t slot) const {
+	return keys[slot];
+}
+
+void coord_table::grow() {
+	++buffer_growths;
+	buckets.assign(buckets.size() * 2, bucket());
+	for (bucket& b : buckets) {
+		b.stamp = 0;
+	}
+	generation = 1;
+	uint32_t mask = uint32_t(buckets.size() - 1);
+	for (uint32_t slot = 0; slot != keys.size(); ++slot) {
+		uint32_t i = hash(keys[slot]) & mask;
+		while (buckets[i].stamp == generation) {
+			i = (i + 1) & mask;
+		}
+		buckets[i].key = keys[slot];
+		buckets[i].stamp = generation;
+		buckets[i].slot = slot;
+	}
+}
+
+int32_t get_item_load_capacity(df::item* item) {
+	// get the container capacity of item <item>
+	PLUGIN_LOG(LEVEL_DEBUG, CATEGORY_LOADING, "get_item_load_capacity: item {} of type {}", item->id, item->getType());
+	
+	// only df::item_toolst instances have an associated container capacity, I think
+	df::item_toolst* item_as_tool = virtual_cast<df::item_toolst>(item);
+	// if item is not a df::item_toolst
+	if (item_as_tool == nullptr) {
+		// item is not a container, so return 0
+		return 0;
+	}
+	df::itemdef_toolst* tool_def = item_as_tool->subtype;
+	return tool_def->container_capacity;
+}
+
+int32_t get_item_loaded_volume(df::item* item) {
+	// get the total volume of all objects inside item <item>
+	std::vector<df::item*> contained_items;
+	Items::getContainedItems(item, &contained_items);
+	int32_t out = 0;
+	for (df::item* item : contained_items) {
+		out += item->getVolume();
+	}
+	return out;
+}
+
+uint64_t get_contents_stamp(df::item* item) {
+	// returns a stamp of which items are inside item <item>: the sum of their ids, each scrambled so that swapping one item for another
+	// changes the sum; O(general_refs of <item>), without looking up the contained items themselves
+	uint64_t out = 0;
+	for (df::general_ref* ref : item->general_refs) {
+		if (ref->getType() == df::general_ref_type::CONTAINS_ITEM) {
+			out += (uint64_t(uint32_t(((df::general_ref_contains_itemst*)ref)->item_id)) + 1) * 0x9E3779B97F4A7C15ull;
+		}
+	}
+	return out;
+}
+
+void revalidate_loaded_volume(minecart_info& info) {
+	// makes info.loaded_volume up to date if DF has changed the minecart's contents since it was last computed
+	// O(general_refs of the minecart) unless the contents have changed
+	df::item* minecart_item = info.minecart_item.get();
+	uint64_t contents_stamp = get_contents_stamp(minecart_item);
+	if (contents_stamp != info.contents_stamp) {
+		info.loaded_volume = get_item_loaded_volume(minecart_item);
+		info.contents_stamp = contents_stamp;
+	}
+}
+
+bool can_item_fit(const minecart_info& info, df::item* check_fit) {
+	// returns whether item <check_fit> can go inside the minecart of <info> without exceeding its capacity
+	// O(1), from the capacity and loaded volume cached in <info>
+	int32_t check_fit_volume = check_fit->getVolume();
+	PLUGIN_LOG(LEVEL_TRACE, CATEGORY_LOADING, "can_item_fit: capacity {}, loaded volume {}, item volume {}", info.load_capacity, info.loaded_volume, check_fit_volume);
+	return info.loaded_volume + check_fit_volume <= info.load_capacity;
+}
+
+bool can_unit_fit(const minecart_info& info, df::unit*) {
+	// returns whether given unit can go inside the minecart of <info>
+	// currently this is whether there is not already a unit inside the minecart
+	return !info.minecart_item.get()->flags2.bits.has_rider;
+}
+
+// projectile_index: projectile id -> the world->proj_list link holding that projectile
+// built lazily at most once per update, so that all the falls landing in one update share a single walk of world->proj_list;
+// unlink_projectile keeps it consistent, and invalidate_projectile_index discards it once the game has run again
+std::unordered_map<int32_t, df::proj_list_link*> projectile_index;
+// projectile_index_valid: whether projectile_index reflects the current state of world->proj_list
+bool projectile_index_valid = false;
+
+void invalidate_projectile_index() {
+	// marks projectile_index as out of date; to be called whenever the game may have changed world->proj_list
+	projectile_index_valid = false;
+}
+
+df::proj_list_link* find_projectile_link(int32_t proj_id) {
+	// returns the link of world->proj_list holding the projectile with id <proj_id>, or nullptr if there is none
+	if (!projectile_index_valid) {
+		projectile_index.clear();
+		for (df::proj_list_link* link = world->proj_list.next; link != nullptr; link = link->next) {
+			if (link->item != nullptr) {
+				projectile_index[link->item->id] = link;
+			}
+		}
+		projectile_index_valid = true;
+		PLUGIN_LOG(LEVEL_DEBUG, CATEGORY_LOADING, "find_projectile_link: indexed {} projectiles", projectile_index.size());
+	}
+	
+	auto iter = projectile_index.find(proj_id);
+	return (iter == projectile_index.end()) ? nullptr : iter->second;
+}
+
+void unlink_projectile(df::proj_list_link* link) {
+	// removes <link> from world->proj_list and projectile_index, and frees it and the projectile it holds
+	df::projectile* proj = link->item;
+	
+	// cut link out of the linked list of which it is part, essentially removing proj from the list of projectiles
+	if (link->prev != nullptr) {
+		link->prev->next = link->next;
+	}
+	if (link->next != nullptr) {
+		link->next->prev = link->prev;
+	}
+	
+	PLUGIN_LOG(LEVEL_TRACE, CATEGORY_LOADING, "unlink_projectile: relinked list around projectile {}", proj->id);
+	
+	projectile_index.erase(proj->id);
+	
+	delete link;
+	
+	// delete proj as void* to avoid calling destructor, which destructor seems to cause a crash
+	// TODO: possibly bad? fix?
+	delete (void*)proj;
+	
+	PLUGIN_LOG(LEVEL_TRACE, CATEGORY_LOADING, "unlink_projectile: deleted link and projectile");
+}
+
+bool is_falling(df::item* item) {
+	// returns whether item <item> is in the air, judged by its own refs rather than world->proj_list
+	for (df::general_ref* ref : item->general_refs) {
+		if (ref->getType() == df::general_ref_type::PROJECTILE) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void make_not_projectile(df::item* item, MapExtras::MapCache& mc) {
+	// makes item <item>, which must currently be a projectile, into not a projectile and puts it on the ground through map cache <mc>
+	PLUGIN_LOG(LEVEL_DEBUG, CATEGORY_LOADING, "make_not_projectile: item {}", item->id);
+	
+	// proj_ref: the stored general_ref of item to a df::projectile object
+	df::general_ref_projectile* proj_ref;
+	// proj_ref_index: the index of proj_ref in item's container of general_refs
+	unsigned int proj_ref_index;
+	
+	for (unsigned int i = 0; i != item->general_refs.size(); ++i) {
+		df::general_ref* ref = item->general_refs[i];
+		if (ref->getType() == df::general_ref_type::PROJECTILE) {
+			proj_ref = (df::general_ref_projectile*)ref;
+			proj_ref_index = i;
+			break;
+		}
+	}
+	
+	PLUGIN_LOG(LEVEL_TRACE, CATEGORY_LOADING, "make_not_projectile: projectile ref at index {}", proj_ref_index);
+	
+	// proj_id: the id of item's associated projectile object
+	int32_t proj_id = proj_ref->projectile_id;
+	// link: the linked list link which holds item's associated projectile object
+	df::proj_list_link* link = find_projectile_link(proj_id);
+	
+	PLUGIN_LOG(LEVEL_TRACE, CATEGORY_LOADING, "make_not_projectile: projectile {} found in list: {}", proj_id, link != nullptr);
+	
+	// the projectile may already be gone from world->proj_list, in which case there is nothing to unlink
+	if (link != nullptr) {
+		unlink_projectile(link);
+	}
+	
+	// erase general_ref to projectile object from vector of general_refs
+	vector_erase_at(item->general_refs, proj_ref_index);
+	
+	item->flags.bits.on_ground = true;
+	
+	mc.addItemOnGround(item);
+	
+	PLUGIN_LOG(LEVEL_TRACE, CATEGORY_LOADING, "make_not_projectile: item {} put on ground at {}", item->id, item->pos);
+}
+
+bool load_minecart_with_item(minecart_info& info, df::item* item, MapExtras::MapCache& mc) {
+	// load the minecart of <info> with item <item>, which must not be a projectile, through map cache <mc>;
+	// returns whether it succeeded
+	// the item's volume must already be counted in info.loaded_volume
+	PLUGIN_LOG(LEVEL_DEBUG, CATEGORY_LOADING, "load_minecart_with_item: item {} into minecart {}", item->id, info.id);
+	
+	// shelved_refs: general_refs of <item> that are forbidden by Items::moveToContainer
+	// these are removed before the call to Items::moveToContainer and restored after
+	// map: index of general_ref -> general_ref itself
+	std::map<size_t, df::general_ref*> shelved_refs;
+	
+	for (size_t i = 0; i != item->general_refs.size(); ++i) {
+		df::general_ref* ref = item->general_refs[i];
+		
+        switch (ref->getType())
+        {
+			case general_ref_type::BUILDING_HOLDER:
+			case general_ref_type::BUILDING_CAGED:
+			case general_ref_type::BUILDING_TRIGGER:
+			case general_ref_type::BUILDING_TRIGGERTARGET:
+			case general_ref_type::BUILDING_CIVZONE_ASSIGNED:
+				shelved_refs.insert(std::make_pair(i, ref));
+				break;
+			default:
+				break;
+        }
+    }
+	
+	PLUGIN_LOG(LEVEL_TRACE, CATEGORY_LOADING, "load_minecart_with_item: shelved {} general_refs", shelved_refs.size());
+	
+	for (auto pr : shelved_refs) {
+		PLUGIN_LOG(LEVEL_TRACE, CATEGORY_LOADING, "load_minecart_with_item: shelved general_ref {} of type {}", pr.first, pr.second->getType());
+	}
+	
+	// erased from the last, so that each erase leaves the indices of those still to be erased as they were
+	for (auto iter = shelved_refs.rbegin(); iter != shelved_refs.rend(); ++iter) {
+		vector_erase_at(item->general_refs, iter->first);
+	}
+	
+	bool did_succeed;
+	{
+		phase_timer timer(PHASE_MOVE_TO_CONTAINER);
+		did_succeed = Items::moveToContainer(mc, item, info.minecart_item.get());
+	}
+	PLUGIN_LOG(LEVEL_DEBUG, CATEGORY_LOADING, "load_minecart_with_item: moved into container: {}", did_succeed);
+	
+	// restoration of shelved_refs
+	for (auto pr : shelved_refs) {
+		item->general_refs.push_back(pr.second);
+	}
+	
+	// the new contained item is accounted for in loaded_volume, so it must not trigger a recomputation
+	info.contents_stamp = get_contents_stamp(info.minecart_item.get());
+	
+	return did_succeed;
+}
+
+bool load_minecart_with_unit(minecart_info& info, df::unit* unit) {
+	// load the minecart of <info> with unit <unit>; returns whether it succeeded
+	PLUGIN_LOG(LEVEL_DEBUG, CATEGORY_LOADING, "load_minecart_with_unit: unit {} into minecart {}", unit->id, info.id);
+	df::item* minecart_item = info.minecart_item.get();
+	
+	// change minecart
+	auto gen_ref = df::allocate<df::general_ref_unit_riderst>();
+	gen_ref->unit_id = unit->id;
+	minecart_item->general_refs.push_back(gen_ref);
+	minecart_item->flags2.bits.has_rider = true;
+	
+	// change unit
+	unit->mount_type = 0;
+	unit->riding_item_id = minecart_item->id;
+	unit->flags1.bits.rider = true;
+	//unit->flags3.bits.exit_vehicle1 = true;
+	
+	return true;
+}
+
+int64_t div_floor(int64_t dividend, int64_t divisor) {
+	// returns floor(dividend/divisor)
+	// (true floor, not rounding towards zero)
+	return (dividend >= 0) ? (dividend / divisor) : ((dividend + 1) / divisor - 1);
+}
+
+bool parse_uint(const std::string& text, unsigned int& out) {
+	// parses <text> as a non-negative decimal integer into <out>; returns whether it succeeded
+	if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos) {
+		return false;
+	}
+	out = (unsigned int)std::strtoul(text.c_str(), nullptr, 10);
+	return true;
+}
+
+
+
+// Load transaction
+// The items accepted for loading during perform_minecart_loading are queued, then loaded together once every minecart has been
+// considered, through one MapExtras::MapCache that is written back once: first every projectile among them is grounded, then
+// every one is moved into its minecart. A queued item's volume is reserved in its minecart's loaded_volume as soon as it is
+// accepted, so that later arrivals in the same update see the minecart as fuller. Units change no map data, so are loaded at once.
+
+struct pending_item_load {
+	// info: stays valid until the commit, as minecarts is not changed during perform_minecart_loading
+	minecart_info* info;
+	df::item* item;
+	// volume: the volume reserved for item in info->loaded_volume
+	int32_t volume;
+};
+
+// pending_item_loads: the item loads queued this update, in the order they were accepted
+std::vector<pending_item_load> pending_item_loads;
+
+const pending_item_load* find_pending_load(df::item* item) {
+	// returns the queued load of item <item>, or nullptr if it is not queued
+	for (const pending_item_load& pending : pending_item_loads) {
+		if (pending.item == item) {
+			return &pending;
+		}
+	}
+	return nullptr;
+}
+
+bool queue_item_load(minecart_info& info, df::item* item) {
+	// queues item <item> to be loaded into the minecart of <info> by the next commit_item_loads; returns whether it was queued
+	// an item already queued for a minecart whose path shares its tile is left to that minecart
+	if (const pending_item_load* pending = find_pending_load(item)) {
+		PLUGIN_LOG(LEVEL_DEBUG, CATEGORY_LOADING, "queue_item_load: item {} already queued for minecart {}", item->id, pending->info->id);
+		return false;
+	}
+	int32_t volume = item->getVolume();
+	info.loaded_volume += volume;
+	push_back_counted(pending_item_loads, pending_item_load{&info, item, volume});
+	return true;
+}
+
+void commit_item_loads() {
+	// loads every queued item into its minecart through one shared map cache, then writes the cache back
+	if (pending_item_loads.empty()) {
+		return;
+	}
+	PLUGIN_LOG(LEVEL_DEBUG, CATEGORY_LOADING, "commit_item_loads: {} items", pending_item_loads.size());
+	MapExtras::MapCache mc;
+	
+	// items that fall mostly land as projectiles, which must be grounded before they can be moved into a container
+	for (const pending_item_load& pending : pending_item_loads) {
+		if (is_falling(pending.item)) {
+			phase_timer timer(PHASE_MAKE_NOT_PROJECTILE);
+			make_not_projectile(pending.item, mc);
+		}
+	}
+	
+	for (const pending_item_load& pending : pending_item_loads) {
+		if (load_minecart_with_item(*pending.info, pending.item, mc)) {
+			count(COUNTER_ITEMS_LOADED);
+		} else {
+			pending.info->loaded_volume -= pending.volume;
+			count(COUNTER_REJECTED_LOAD_FAILED);
+		}
+	}
+	
+	{
+		phase_timer timer(PHASE_WRITE_MAP_CACHE);
+		mc.WriteAll();
+	}
+	pending_item_loads.clear();
+}
+
+
+
+// Landing resolution
+// Several items may land on one minecart in the same update, between them more than it has room for. Loaded first come, first
+// served, one large item can then crowd out several small ones that landed with it. Instead, the items that landed on a minecart
+// are gathered into a batch, and which of them to load is chosen from the whole batch at once, by packing_mode; a haul route is
+// measured by the items moved per trip, so by default as many as fit. A minecart's filter may also give a priority order of item
+// types, in which case the items of each rank are chosen among in turn, the best ranked first, each rank from the room the ranks
+// before it left. Units take up no volume, so are loaded as they are found.
+
+enum packing_mode_t : uint32_t {
+	// PACKING_ARRIVAL: load the items in the order they were found, each if it still fits
+	PACKING_ARRIVAL,
+	// PACKING_COUNT: load as many items as fit, then among those choices the one filling the most volume, greedily
+	PACKING_COUNT,
+	// PACKING_VOLUME: fill as much of the free volume as possible, greedily, largest item first
+	PACKING_VOLUME,
+	PACKING_MODE_COUNT
+};
+
+const char* const PACKING_MODE_NAMES[PACKING_MODE_COUNT] = {
+	"arrival",
+	"count",
+	"volume"
+};
+
+// packing_mode: how the items that landed on a minecart in the same update are chosen among
+packing_mode_t packing_mode = PACKING_COUNT;
+
+struct landing {
+	// an item that landed on a minecart, with the volume it is taken to have
+	Loadable loadable;
+	int32_t volume;
+	// rank: the item's rank in the minecart's priority order, 0 being the best; 0 for all when there is none
+	uint8_t rank;
+};
+
+// landing_batch: the items that landed on the minecart being considered by perform_minecart_loading, in the order found
+std::vector<landing> landing_batch;
+
+void add_landing(std::vector<landing>& batch, const Loadable& loadable, int32_t volume, uint8_t rank) {
+	// adds <loadable>, of volume <volume> and rank <rank>, to <batch>, unless it is already there, as when it was both above a
+	// path tile and staged in the column above it
+	for (const landing& landed : batch) {
+		if (landed.loadable == loadable) {
+			return;
+		}
+	}
+	push_back_counted(batch, landing{loadable, volume, rank});
+}
+
+unsigned int choose_landings_of_rank(std::vector<landing>& batch, size_t begin, size_t end, int32_t& free_volume, packing_mode_t mode) {
+	// as choose_landings, for the landings <begin> to <end> - 1 of <batch>, all of one rank: reorders them so that those to load
+	// come first, takes their volume off <free_volume>, and returns how many they are
+	auto smaller = [](const landing& a, const landing& b) { return a.volume < b.volume; };
+	auto larger = [](const landing& a, const landing& b) { return a.volume > b.volume; };
+	
+	if (mode == PACKING_COUNT) {
+		// the most items that fit are the smallest ones
+		std::stable_sort(batch.begin() + begin, batch.begin() + end, smaller);
+		size_t chosen = begin;
+		while (chosen != end && batch[chosen].volume <= free_volume) {
+			free_volume -= batch[chosen].volume;
+			++chosen;
+		}
+		// then trade each chosen item, largest first, for the largest unchosen one that still fits in its place
+		// the volume the trade may take only shrinks as this goes on, so the candidates are walked down only once
+		size_t candidate = end;
+		for (size_t i = chosen; i-- != begin && candidate > chosen;) {
+			while (candidate > chosen && batch[candidate - 1].volume > batch[i].volume + free_volume) {
+				--candidate;
+			}
+			if (candidate > chosen && batch[candidate - 1].volume > batch[i].volume) {
+				--candidate;
+				free_volume -= batch[candidate].volume - batch[i].volume;
+				std::swap(batch[i], batch[candidate]);
+			}
+		}
+		return (unsigned int)(chosen - begin);
+	}
+	
+	if (mode == PACKING_VOLUME) {
+		std::stable_sort(batch.begin() + begin, batch.begin() + end, larger);
+	}
+	// first fit, moving each chosen landing up behind those chosen before it
+	size_t chosen = begin;
+	for (size_t i = begin; i != end; ++i) {
+		if (batch[i].volume <= free_volume) {
+			free_volume -= batch[i].volume;
+			std::rotate(batch.begin() + chosen, batch.begin() + i, batch.begin() + i + 1);
+			++chosen;
+		}
+	}
+	return (unsigned int)(chosen - begin);
+}
+
+unsigned int choose_landings(std::vector<landing>& batch, int32_t free_volume, packing_mode_t mode) {
+	// reorders <batch> so that the landings to load, at most <free_volume> in total, come first in the order to load them,
+	// and returns how many they are; O(n log n) in the size of <batch>
+	// the ranks are chosen among in turn, best first; the order found is kept within each, for PACKING_ARRIVAL
+	std::stable_sort(batch.begin(), batch.end(), [](const landing& a, const landing& b) { return a.rank < b.rank; });
+	unsigned int chosen = 0;
+	for (size_t begin = 0; begin != batch.size();) {
+		size_t end = begin + 1;
+		while (end != batch.size() && batch[end].rank == batch[begin].rank) {
+			++end;
+		}
+		unsigned int chosen_of_rank = choose_landings_of_rank(batch, begin, end, free_volume, mode);
+		// moved up behind those chosen from the ranks before
+		std::rotate(batch.begin() + chosen, batch.begin() + begin, batch.begin() + begin + chosen_of_rank);
+		chosen += chosen_of_rank;
+		begin = end;
+	}
+	return chosen;
+}
+
+
+
+// Loading filters
+// By default, whatever lands on a minecart is loaded if it fits. A filter, set from the console for a route or a single minecart
+// and stored with the save, restricts this by item type, material, forbid and dump flags, or to items or units only. Its text is
+// compiled once into a bitset of item types, a sorted table of materials and masks of item flags, so that checking a candidate
+// is a few compares. A candidate is put to the filter only once it has landed on a minecart, before its fit is looked at; and
+// when every awake minecart's filter rejects an item type, or units, such candidates are dropped as the watched tiles are filled
+// rather than recorded and carried along. A minecart's own filter takes precedence over its route's.
+
+// ITEM_TYPE_LIMIT: one more than the greatest item type
+const size_t ITEM_TYPE_LIMIT = size_t(ENUM_LAST_ITEM(item_type)) + 1;
+// FILTER_KEY_PREFIX: prefix of the keys of the filters stored with the save, followed by "route/<id>" or "cart/<id>"
+const std::string FILTER_KEY_PREFIX = "minecart_fall_loading/filter/";
+
+struct load_filter {
+	// a filter, as compiled from its text by compile_filter
+	std::string text;
+	// items, units: whether items, and units, may be loaded at all
+	bool items;
+	bool units;
+	// item_types: bit t is set if items of type t may be loaded
+	std::bitset<ITEM_TYPE_LIMIT> item_types;
+	// flags_required, flags_rejected: item flags which must all be set, and item flags none of which may be set
+	uint32_t flags_required;
+	uint32_t flags_rejected;
+	// materials: the materials listed, as pack_material keys, sorted
+	std::vector<uint64_t> materials;
+	// materials_only: whether items must be of one of materials, rather than of none of them
+	bool materials_only;
+	// prioritized: whether the filter gives a priority order of item types, by a priority= rule
+	bool prioritized;
+	// ranks: the rank of each item type in the priority order, 0 being the best, with the types not listed after all those
+	// listed; all 0 unless prioritized
+	std::array<uint8_t, ITEM_TYPE_LIMIT> ranks;
+};
+
+// route_filters, cart_filters: the filters set for routes, by route id, and for single minecarts, by vehicle id
+// maps, so that the filters minecarts point to stay put while others are set
+std::map<int32_t, load_filter> route_filters;
+std::map<int32_t, load_filter> cart_filters;
+// filters_generation: incremented whenever the filters change, so that each minecart resolves its filter again
+uint32_t filters_generation = 1;
+
+inline uint64_t pack_material(int16_t type, int32_t index) {
+	// returns the key in load_filter::materials of the material of type <type> and index <index>
+	return (uint64_t(uint16_t(type)) << 32) | uint32_t(index);
+}
+
+bool compile_filter(const std::string& text, load_filter& out, std::string& error) {
+	// compiles filter <text> into <out>; returns whether it succeeded, and if not sets <error>
+	// <text> is a space-separated list of rules: items, no-items, units, no-units, type=<types>, type!=<types>,
+	// material=<materials>, material!=<materials>, forbidden=<yes|no>, dump=<yes|no>, priority=<types>
+	// types are item type names and materials are material tokens, both comma-separated
+	out = load_filter();
+	out.text = text;
+	out.items = true;
+	out.units = true;
+	out.item_types.set();
+	out.materials_only = false;
+	out.prioritized = false;
+	out.ranks.fill(0);
+	// types_listed: whether a type= rule has been applied, after which only the types listed may be loaded
+	bool types_listed = false;
+	bool materials_listed = false;
+	
+	std::vector<std::string> rules;
+	split_string(&rules, text, " ", true);
+	for (const std::string& rule : rules) {
+		if (rule.empty()) {
+			continue;
+		}
+		if (rule == "items" || rule == "no-items") {
+			out.items = rule == "items";
+			continue;
+		}
+		if (rule == "units" || rule == "no-units") {
+			out.units = rule == "units";
+			continue;
+		}
+		
+		size_t equals = rule.find('=');
+		if (equals == std::string::npos || equals == 0) {
+			error = "unknown rule " + rule;
+			return false;
+		}
+		bool negated = rule[equals - 1] == '!';
+		std::string name = rule.substr(0, negated ? equals - 1 : equals);
+		std::vector<std::string> values;
+		split_string(&values, rule.substr(equals + 1), ",");
+		
+		if (name == "type") {
+			if (!negated && !types_listed) {
+				out.item_types.reset();
+				types_listed = true;
+			}
+			for (const std::string& value : values) {
+				df::item_type type;
+				if (!find_enum_item(&type, value) || type < 0 || size_t(type) >= ITEM_TYPE_LIMIT) {
+					error = "unknown item type " + value;
+					return false;
+				}
+				out.item_types[size_t(type)] = !negated;
+			}
+		} else if (name == "material") {
+			if (materials_listed) {
+				error = "more than one material rule";
+				return false;
+			}
+			materials_listed = true;
+			out.materials_only = !negated;
+			for (const std::string& value : values) {
+				MaterialInfo material;
+				if (!material.find(value)) {
+					error = "unknown material " + value;
+					return false;
+				}
+				out.materials.push_back(pack_material(material.type, material.index));
+			}
+			std::sort(out.materials.begin(), out.materials.end());
+			out.materials.erase(std::unique(out.materials.begin(), out.materials.end()), out.materials.end());
+		} else if (name == "priority" && !negated) {
+			if (out.prioritized) {
+				error = "more than one priority rule";
+				return false;
+			}
+			out.prioritized = true;
+			// unlisted: the rank of the types not listed; a type listed twice keeps its first rank
+			const uint8_t unlisted = UINT8_MAX;
+			out.ranks.fill(unlisted);
+			uint8_t rank = 0;
+			for (const std::string& value : values) {
+				df::item_type type;
+				if (!find_enum_item(&type, value) || type < 0 || size_t(type) >= ITEM_TYPE_LIMIT) {
+					error = "unknown item type " + value;
+					return false;
+				}
+				if (out.ranks[size_t(type)] == unlisted) {
+					out.ranks[size_t(type)] = rank++;
+				}
+			}
+			std::replace(out.ranks.begin(), out.ranks.end(), unlisted, rank);
+		} else if ((name == "forbidden" || name == "dump") && !negated && values.size() == 1 && (values[0] == "yes" || values[0] == "no")) {
+			df::item_flags mask;
+			mask.whole = 0;
+			if (name == "forbidden") {
+				mask.bits.forbid = true;
+			} else {
+				mask.bits.dump = true;
+			}
+			(values[0] == "yes" ? out.flags_required : out.flags_rejected) |= mask.whole;
+		} else {
+			error = "unknown rule " + rule;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool item_passes_filter(const load_filter& filter, df::item* item) {
+	// returns whether <filter> lets item <item> be loaded
+	if (!filter.items) {
+		return false;
+	}
+	uint32_t flags = item->flags.whole;
+	if ((flags & filter.flags_rejected) != 0 || (flags & filter.flags_required) != filter.flags_required) {
+		return false;
+	}
+	int32_t type = item->getType();
+	if (type < 0 || size_t(type) >= ITEM_TYPE_LIMIT || !filter.item_types[size_t(type)]) {
+		return false;
+	}
+	if (filter.materials.empty() && !filter.materials_only) {
+		return true;
+	}
+	uint64_t material = pack_material(item->getMaterial(), item->getMaterialIndex());
+	return std::binary_search(filter.materials.begin(), filter.materials.end(), material) == filter.materials_only;
+}
+
+void refresh_filter(minecart_info& info) {
+	// brings info.filter up to date with the filters and the minecart's route; O(1) unless either has changed
+	int32_t route = info.minecart->route_id;
+	if (info.filter_generation == filters_generation && info.filter_route == route) {
+		return;
+	}
+	info.filter_generation = filters_generation;
+	info.filter_route = route;
+	
+	auto cart_filter = cart_filters.find(info.id);
+	if (cart_filter != cart_filters.end()) {
+		info.filter = &cart_filter->second;
+		return;
+	}
+	auto route_filter = route_filters.find(route);
+	info.filter = route_filter != route_filters.end() ? &route_filter->second : nullptr;
+}
+
+struct wanted_loadables {
+	// what the filters of a set of minecarts could let be loaded into any of them, as gathered by add_wanted
+	// item_types: bit t is set if items of type t could be loaded
+	std::bitset<ITEM_TYPE_LIMIT> item_types;
+	// units: whether units could be loaded
+	bool units;
+	// everything: whether every item type and units could be, so that nothing need be checked
+	bool everything;
+};
+
+// wanted: what the filters of the awake minecarts could let be loaded, gathered by update_minecart_info before each fill;
+// loadables found on the watched tiles that none of them wants are dropped by group_tile_matches, as none would be loaded
+wanted_loadables wanted = { std::bitset<ITEM_TYPE_LIMIT>().set(), true, true };
+
+void want_everything() {
+	// lets whatever is found on the watched tiles be recorded, as when replaying or benchmarking
+	wanted.item_types.set();
+	wanted.units = true;
+	wanted.everything = true;
+}
+
+void want_nothing() {
+	// clears what is wanted, before add_wanted is called for each awake minecart
+	wanted.item_types.reset();
+	wanted.units = false;
+	wanted.everything = false;
+}
+
+void add_wanted(const load_filter* filter) {
+	// adds what <filter>, or no filter for nullptr, could let be loaded to what is wanted
+	if (wanted.everything) {
+		return;
+	}
+	if (filter == nullptr) {
+		want_everything();
+		return;
+	}
+	if (filter->items) {
+		wanted.item_types |= filter->item_types;
+	}
+	wanted.units = wanted.units || filter->units;
+	wanted.everything = wanted.units && wanted.item_types.all();
+}
+
+std::string get_filter_key(bool for_route, int32_t id) {
+	// returns the key with which the filter of route (<for_route> true) or minecart (<for_route> false) <id> is stored
+	return FILTER_KEY_PREFIX + (for_route ? "route/" : "cart/") + std::to_string(id);
+}
+
+bool set_filter(bool for_route, int32_t id, const std::string& text, std::string& error) {
+	// sets the filter of route (<for_route> true) or minecart (<for_route> false) <id> to <text>, and stores it with the save;
+	// returns whether <text> compiled, and if not sets <error>
+	load_filter filter;
+	if (!compile_filter(text, filter, error)) {
+		return false;
+	}
+	(for_route ? route_filters : cart_filters)[id] = filter;
+	++filters_generation;
+	
+	std::string key = get_filter_key(for_route, id);
+	PersistentDataItem stored = World::GetPersistentData(key);
+	if (!stored.isValid()) {
+		stored = World::AddPersistentData(key);
+	}
+	if (stored.isValid()) {
+		stored.val() = text;
+	} else {
+		PLUGIN_LOG(LEVEL_ERROR, CATEGORY_GENERAL, "set_filter: could not store the filter of id {}, route: {}", id, for_route);
+	}
+	return true;
+}
+
+void clear_filter(bool for_route, int32_t id) {
+	// removes the filter of route (<for_route> true) or minecart (<for_route> false) <id>, including from the save
+	(for_route ? route_filters : cart_filters).erase(id);
+	++filters_generation;
+	
+	PersistentDataItem stored = World::GetPersistentData(get_filter_key(for_route, id));
+	if (stored.isValid()) {
+		World::DeletePersistentData(stored);
+	}
+}
+
+void load_filters() {
+	// replaces the filters with those stored with the save; called when a map is loaded
+	route_filters.clear();
+	cart_filters.clear();
+	++filters_generation;
+	
+	std::vector<PersistentDataItem> stored;
+	World::GetPersistentData(&stored, FILTER_KEY_PREFIX, true);
+	for (PersistentDataItem& data : stored) {
+		// target: "route/<id>" or "cart/<id>"
+		std::string target = data.key().substr(FILTER_KEY_PREFIX.size());
+		size_t slash = target.find('/');
+		unsigned int id;
+		bool for_route = target.compare(0, slash, "route") == 0;
+		if (slash == std::string::npos || (!for_route && target.compare(0, slash, "cart") != 0) || !parse_uint(target.substr(slash + 1), id)) {
+			PLUGIN_LOG(LEVEL_ERROR, CATEGORY_GENERAL, "load_filters: ignoring a stored filter with an unknown key");
+			continue;
+		}
+		load_filter filter;
+		std::string error;
+		if (!compile_filter(data.val(), filter, error)) {
+			PLUGIN_LOG(LEVEL_ERROR, CATEGORY_GENERAL, "load_filters: ignoring the stored filter of id {}, route: {}, which no longer compiles", id, for_route);
+			continue;
+		}
+		(for_route ? route_filters : cart_filters)[int32_t(id)] = filter;
+	}
+	PLUGIN_LOG(LEVEL_INFO, CATEGORY_GENERAL, "load_filters: {} route filters, {} minecart filters", route_filters.size(), cart_filters.size());
+}
+
+
+
+
+// Path prediction
+// Rather than only the tile a minecart will be in after one tick, the whole swept path over the next few ticks is predicted,
+// so that a fast minecart crossing a tile between updates still catches what falls on that tile. Something found on a crossed
+// tile is only loaded if it landed while the path had the minecart on that tile, and not after it had left or before it came.
+
+// lookahead_ticks: number of ticks ahead for which each minecart's path is predicted; at least update_interval is always used
+unsigned int lookahead_ticks = 2;
+// PATH_SUBSTEPS: number of samples per tick when sweeping a path, so that tiles crossed within a tick are not skipped
+const int32_t PATH_SUBSTEPS = 4;
+
+df::coord get_predicted_pos(df::coord pos, int32_t offset_x, int32_t offset_y, int32_t offset_z, int32_t speed_x, int32_t speed_y,
+	int32_t speed_z, int32_t substeps) {
+	// returns the predicted position, after <substeps> / PATH_SUBSTEPS ticks, of a minecart on coord <pos> with offsets <offset_x>,
+	// <offset_y>, <offset_z> moving at speeds <speed_x>, <speed_y>, <speed_z>
+	// offsets are in 1/100000ths of a tile from the tile's centre
+	return pos + df::coord(
+		div_floor(offset_x + int64_t(speed_x) * substeps / PATH_SUBSTEPS + 50000, 100000),
+		div_floor(offset_y + int64_t(speed_y) * substeps / PATH_SUBSTEPS + 50000, 100000),
+		div_floor(offset_z + int64_t(speed_z) * substeps / PATH_SUBSTEPS + 50000, 100000)
+	);
+}
+
+df::coord get_predicted_pos(const cart_motion& motion, df::coord current_pos, int32_t substeps) {
+	// returns the predicted position after <substeps> / PATH_SUBSTEPS ticks of a minecart moving as <motion>
+	// <current_pos> is current position of the minecart
+	return get_predicted_pos(current_pos, motion.offset_x, motion.offset_y, motion.offset_z,
+		motion.speed_x, motion.speed_y, motion.speed_z, substeps);
+}
+
+cart_motion get_motion(const df::vehicle* minecart) {
+	// returns the current offsets and speed of minecart <minecart>
+	cart_motion motion;
+	motion.offset_x = minecart->offset_x;
+	motion.offset_y = minecart->offset_y;
+	motion.offset_z = minecart->offset_z;
+	motion.speed_x = minecart->speed_x;
+	motion.speed_y = minecart->speed_y;
+	motion.speed_z = minecart->speed_z;
+	return motion;
+}
+
+bool same_speed(const cart_motion& a, const cart_motion& b) {
+	// returns whether motions <a> and <b> have the same speed
+	return a.speed_x == b.speed_x && a.speed_y == b.speed_y && a.speed_z == b.speed_z;
+}
+
+bool same_motion(const cart_motion& a, const cart_motion& b) {
+	// returns whether motions <a> and <b> have the same offsets and speed
+	return same_speed(a, b) && a.offset_x == b.offset_x && a.offset_y == b.offset_y && a.offset_z == b.offset_z;
+}
+
+unsigned int extend_path(df::coord* path, unsigned int path_length, const cart_motion& motion, unsigned int horizon_ticks) {
+	// sweeps a minecart moving as <motion> over the next <horizon_ticks> ticks from path[0], its current position,
+	// keeping the tiles of the <path_length> tiles of <path> that are still predicted and appending the tiles beyond its end,
+	// and returns the new length
+	// if the sweep leaves <path> partway along, the rest of <path> is replaced, and if it ends short of its end, as once the
+	// horizon has been lowered, the rest is dropped
+	// matched: index into path of the tile the sweep is currently in
+	unsigned int matched = 0;
+	
+	for (int32_t substeps = 1; substeps <= int32_t(horizon_ticks) * PATH_SUBSTEPS; ++substeps) {
+		df::coord tile = get_predicted_pos(motion, path[0], substeps);
+		if (tile == path[matched]) {
+			continue;
+		}
+		if (matched + 1 < path_length && tile == path[matched + 1]) {
+			++matched;
+			continue;
+		}
+		// the sweep leaves the known path here
+		if (matched + 1 == MAX_PATH_TILES) {
+			break;
+		}
+		++matched;
+		path[matched] = tile;
+	}
+	return matched + 1;
+}
+
+unsigned int count_crossed_tiles(const minecart_info& info, df::coord current_pos) {
+	// returns the number of tiles of the last recorded path of the minecart of <info>, now at <current_pos>, that it has passed
+	// through since the last update, up to and including <current_pos>; 0 if it has left the path, in which case nothing was
+	// watched for it
+	for (unsigned int i = 0; i != info.path_length; ++i) {
+		if (info.path[i] == current_pos) {
+			return i + 1;
+		}
+	}
+	return 0;
+}
+
+bool was_on_tile(const minecart_info& info, unsigned int tile, unsigned int crossed, int32_t tick, unsigned int horizon_ticks) {
+	// returns whether the minecart of <info>, having crossed <crossed> tiles of its last recorded path, was on path tile <tile>
+	// during the <tick>th tick after info.path_tick, as the path predicted: it got there by the end of that tick, and, unless
+	// <tile> is the one it is now on, had not left before it began; <horizon_ticks> bounds the sweep, past which it stays
+	// O(<horizon_ticks> * PATH_SUBSTEPS), so only called for a loadable that has landed
+	int32_t enter_substep = tile == 0 ? 0 : -1;
+	int32_t leave_substep = -1;
+	unsigned int index = 0;
+	for (int32_t substeps = 1; substeps <= int32_t(horizon_ticks) * PATH_SUBSTEPS && leave_substep == -1; ++substeps) {
+		df::coord pos = get_predicted_pos(info.path_motion, info.path[0], substeps);
+		if (pos == info.path[index]) {
+			continue;
+		}
+		++index;
+		if (index == tile) {
+			enter_substep = substeps;
+		} else if (index == tile + 1) {
+			leave_substep = substeps;
+		}
+	}
+	// a minecart the prediction has not reached <tile> yet got there sooner than predicted; when is not known
+	if (enter_substep == -1) {
+		return true;
+	}
+	bool left = tile + 1 != crossed && leave_substep != -1;
+	return enter_substep <= tick * PATH_SUBSTEPS && (!left || leave_substep > (tick - 1) * PATH_SUBSTEPS);
+}
+
+unsigned int advance_path(df::coord* path, unsigned int path_length, const cart_motion& path_motion, df::coord current_pos,
+	const cart_motion& motion, unsigned int horizon_ticks) {
+	// brings the <path_length> tiles of <path>, predicted from <path_motion>, up to date for a minecart now at <current_pos>
+	// and moving as <motion>, and returns the new length
+	// if the minecart kept its speed and is somewhere along its path, the tiles it has passed are dropped and the path
+	// is extended to the new horizon; otherwise the path is predicted afresh
+	// takes no DF objects, so that the planner thread can run it on its snapshot
+	unsigned int passed = path_length;
+	if (same_speed(motion, path_motion)) {
+		for (unsigned int i = 0; i != path_length; ++i) {
+			if (path[i] == current_pos) {
+				passed = i;
+				break;
+			}
+		}
+	}
+	
+	if (passed == path_length) {
+		path[0] = current_pos;
+		path_length = 1;
+	} else if (passed != 0) {
+		std::copy(path + passed, path + path_length, path);
+		path_length -= passed;
+	}
+	
+	return extend_path(path, path_length, motion, horizon_ticks);
+}
+
+void advance_path(minecart_info& info, df::coord current_pos, unsigned int horizon_ticks) {
+	// brings info.path up to date for the minecart of <info>, now at <current_pos>
+	cart_motion motion = get_motion(info.minecart);
+	info.path_length = advance_path(info.path, info.path_length, info.path_motion, current_pos, motion, horizon_ticks);
+	info.path_motion = motion;
+}
+
+
+
+// implementation functions of Loadable delegate to global functions according to the kind of object wrapped
+
+Loadable::Loadable()
+  : contents_kind(ITEM),
+    contents_id(-1),
+    cached_stamp(0),
+    generation(world_generation)
+{
+	cached.item = nullptr;
+}
+
+Loadable::Loadable(df::item* i_contents)
+  : contents_kind(ITEM),
+    contents_id(i_contents->id),
+    cached_stamp(current_epoch<df::item>()),
+    generation(world_generation)
+{
+	cached.item = i_contents;
+}
+
+Loadable::Loadable(df::unit* i_contents)
+  : contents_kind(UNIT),
+    contents_id(i_contents->id),
+    cached_stamp(current_epoch<df::unit>()),
+    generation(world_generation)
+{
+	cached.unit = i_contents;
+}
+
+Loadable::Loadable(kind_t i_kind, int32_t i_id)
+  : contents_kind(i_kind),
+    contents_id(i_id),
+    cached_stamp(0),
+    generation(world_generation)
+{
+	cached.item = nullptr;
+}
+
+Loadable::kind_t Loadable::kind() const {
+	return contents_kind;
+}
+
+int32_t Loadable::id() const {
+	return contents_id;
+}
+
+df::item* Loadable::item() const {
+	return resolve_handle(contents_id, generation, cached.item, cached_stamp);
+}
+
+df::unit* Loadable::unit() const {
+	return resolve_handle(contents_id, generation, cached.unit, cached_stamp);
+}
+
+df::coord Loadable::pos() const {
+	switch (contents_kind) {
+		case ITEM:
+			if (df::item* contents = item()) {
+				return Items::getPosition(contents);
+			}
+			break;
+		case UNIT:
+			if (df::unit* contents = unit()) {
+				return Units::getPosition(contents);
+			}
+			break;
+	}
+	return df::coord();
+}
+
+bool Loadable::passes_filter(const minecart_info& info) const {
+	if (info.filter == nullptr) {
+		return true;
+	}
+	switch (contents_kind) {
+		case ITEM:
+			return item() != nullptr && item_passes_filter(*info.filter, item());
+		case UNIT:
+			return info.filter->units;
+	}
+	return false;
+}
+
+bool Loadable::is_wanted() const {
+	if (wanted.everything) {
+		return true;
+	}
+	switch (contents_kind) {
+		case ITEM: {
+			df::item* item = this->item();
+			if (item == nullptr) {
+				return false;
+			}
+			int32_t type = item->getType();
+			return type >= 0 && size_t(type) < ITEM_TYPE_LIMIT && wanted.item_types[size_t(type)];
+		}
+		case UNIT:
+			return wanted.units;
+	}
+	return false;
+}
+
+bool Loadable::can_fit(const minecart_info& info) const {
+	switch (contents_kind) {
+		case ITEM:
+			return item() != nullptr && can_item_fit(info, item());
+		case UNIT:
+			return unit() != nullptr && can_unit_fit(info, unit());
+	}
+	return false;
+}
+
+bool Loadable::load(minecart_info& info) const {
+	switch (contents_kind) {
+		case ITEM:
+			return item() != nullptr && queue_item_load(info, item());
+		case UNIT:
+			return unit() != nullptr && load_minecart_with_unit(info, unit());
+	}
+	return false;
+}
+
+bool Loadable::operator==(const Loadable& other) const {
+	return contents_kind == other.contents_kind && contents_id == other.contents_id;
+}
+
+bool Loadable::operator<(const Loadable& other) const {
+	if (contents_kind != other.contents_kind) {
+		return contents_kind < other.contents_kind;
+	}
+	return contents_id < other.contents_id;
+}
+
+
+
+// Position snapshot
+// For scans of all items, the positions of world->items.all are kept packed in x, y and z arrays of int16, so that matching them
+// against the watched tiles is a streaming pass over a few bytes per item, done several items at a time with vector instructions,
+// rather than a call to Items::getPosition on every scattered df::item. The snapshot follows world->items.all by id, so items
+// coming and going only cost reading the positions of those added, and it is fully re-read every snapshot_refresh updates. In
+// between, only the items that can move without being touched by the plugin's own scan are re-read: those in the air, those
+// carried by active units, the tracked minecarts, and whatever is inside these, along with the items found moving by the
+// previous update, which may have come to rest since. An item picked up and put down again between two updates is not seen to
+// have moved until the next full refresh.
+
+// SNAPSHOT_LANES: the arrays are padded to a multiple of this, so the kernel never needs a partial load
+const size_t SNAPSHOT_LANES = 16;
+// SNAPSHOT_NOWHERE: coordinate of the padding; never that of a watched tile
+const int16_t SNAPSHOT_NOWHERE = INT16_MIN;
+
+struct position_snapshot {
+	// x, y, z: position of the item at each index of world->items.all, padded with SNAPSHOT_NOWHERE to a multiple of SNAPSHOT_LANES
+	std::vector<int16_t> x;
+	std::vector<int16_t> y;
+	std::vector<int16_t> z;
+	// ids: id of the item at each index, which the next refresh diffs world->items.all against
+	std::vector<int32_t> ids;
+	// count: number of items in the snapshot, before the padding
+	size_t count;
+	// moving_ids: ids of the items found moving by the last refresh, which the next re-reads whether or not they still are
+	std::vector<int32_t> moving_ids;
+	// stale: whether the next refresh must be a full one, the snapshot having been let go out of date
+	bool stale;
+	// refreshed_update: the info_update of the last refresh; a partial refresh must follow on from the update before, or the
+	// items moving during the updates skipped would be missed
+	uint64_t refreshed_update;
+	// updates_since_refresh: partial refreshes since the last full refresh
+	unsigned int updates_since_refresh;
+};
+
+// snapshot_refresh: if non-zero, scans of all items match against item_snapshot, fully refreshed at least every
+// snapshot_refresh updates; 0 to always scan the items themselves
+unsigned int snapshot_refresh = 0;
+// item_snapshot: the snapshot of the positions of world->items.all
+position_snapshot item_snapshot = position_snapshot();
+// info_update: number of the current update, counted by update_minecart_info
+uint64_t info_update = 0;
+// snapshot_rereads, moving_scratch, moving_contents: buffers of refresh_item_snapshot: the indices it re-reads, the items yet to
+// be gone through for being moving, and the contents of one of them
+std::vector<uint32_t> snapshot_rereads;
+std::vector<df::item*> moving_scratch;
+std::vector<df::item*> moving_contents;
+
+void set_snapshot_pos(position_snapshot& snapshot, size_t index, df::coord pos) {
+	// records <pos> as the position of the item at <index> of <snapshot>
+	snapshot.x[index] = pos.x;
+	snapshot.y[index] = pos.y;
+	snapshot.z[index] = pos.z;
+}
+
+void resize_snapshot(position_snapshot& snapshot, size_t count) {
+	// sizes <snapshot> for <count> items, filling the padding with SNAPSHOT_NOWHERE
+	size_t padded = (count + SNAPSHOT_LANES - 1) / SNAPSHOT_LANES * SNAPSHOT_LANES;
+	snapshot.count = count;
+	for (std::vector<int16_t>* axis : {&snapshot.x, &snapshot.y, &snapshot.z}) {
+		resize_counted(*axis, padded);
+		std::fill(axis->begin() + count, axis->end(), SNAPSHOT_NOWHERE);
+	}
+	resize_counted(snapshot.ids, count);
+}
+
+size_t find_item_index(int32_t id) {
+	// returns the index of the item with id <id> in world->items.all, which is sorted by id as df::item::find relies on,
+	// or world->items.all.size() if there is none
+	const std::vector<df::item*>& items = world->items.all;
+	auto iter = std::lower_bound(
+		items.begin(),
+		items.end(),
+		id,
+		[](const df::item* item, int32_t id) { return item->id < id; }
+	);
+	return iter != items.end() && (*iter)->id == id ? size_t(iter - items.begin()) : items.size();
+}
+
+bool diff_item_snapshot() {
+	// re-indexes item_snapshot to follow world->items.all, reading the positions of the items added since the last refresh but
+	// not those of the items kept; returns false if world->items.all cannot be diffed, in which case item_snapshot must be
+	// fully refreshed
+	// DF gives every new item an id above all existing ones, so both are in the same order up to the first index at which they
+	// differ, found by bisection; from there, the kept items are moved down over the removed ones, which never overtakes the
+	// reads, and the added items come after all the kept ones
+	const std::vector<df::item*>& items = world->items.all;
+	position_snapshot& snapshot = item_snapshot;
+	size_t old_count = snapshot.count;
+	size_t first = 0;
+	size_t last = std::min(old_count, items.size());
+	while (first != last) {
+		size_t middle = first + (last - first) / 2;
+		if (items[middle]->id == snapshot.ids[middle]) {
+			first = middle + 1;
+		} else {
+			last = middle;
+		}
+	}
+	
+	resize_snapshot(snapshot, std::max(old_count, items.size()));
+	// read: index of the next old entry not yet kept or dropped
+	size_t read = first;
+	for (size_t i = first; i != items.size(); ++i) {
+		int32_t id = items[i]->id;
+		while (read != old_count && snapshot.ids[read] < id) {
+			++read;
+		}
+		if (read == old_count) {
+			snapshot.ids[i] = id;
+			set_snapshot_pos(snapshot, i, Items::getPosition(items[i]));
+		} else if (snapshot.ids[read] == id) {
+			snapshot.ids[i] = id;
+			snapshot.x[i] = snapshot.x[read];
+			snapshot.y[i] = snapshot.y[read];
+			snapshot.z[i] = snapshot.z[read];
+			++read;
+		} else {
+			// a new item below an existing id, which is not how DF hands them out
+			return false;
+		}
+	}
+	resize_snapshot(snapshot, items.size());
+	return true;
+}
+
+void refresh_item_snapshot() {
+	// brings item_snapshot up to date for this update, fully or partially
+	const std::vector<df::item*>& items = world->items.all;
+	bool full = item_snapshot.stale
+		|| item_snapshot.refreshed_update + 1 != info_update
+		|| item_snapshot.updates_since_refresh + 1 >= snapshot_refresh
+		|| !diff_item_snapshot();
+	item_snapshot.refreshed_update = info_update;
+	
+	snapshot_rereads.clear();
+	if (full) {
+		resize_snapshot(item_snapshot, items.size());
+		for (size_t i = 0; i != items.size(); ++i) {
+			item_snapshot.ids[i] = items[i]->id;
+			set_snapshot_pos(item_snapshot, i, Items::getPosition(items[i]));
+		}
+		item_snapshot.stale = false;
+		item_snapshot.updates_since_refresh = 0;
+	} else {
+		// the items moving at the last refresh may have come to rest since
+		for (int32_t id : item_snapshot.moving_ids) {
+			size_t index = find_item_index(id);
+			if (index != items.size()) {
+				push_back_counted(snapshot_rereads, uint32_t(index));
+			}
+		}
+		++item_snapshot.updates_since_refresh;
+	}
+	
+	// an item moves in the air, held by a unit, as a minecart rolling along, or inside another item doing any of these
+	moving_scratch.clear();
+	for (df::proj_list_link* link = world->proj_list.next; link != nullptr; link = link->next) {
+		df::proj_itemst* proj = virtual_cast<df::proj_itemst>(link->item);
+		if (proj != nullptr && proj->item != nullptr) {
+			push_back_counted(moving_scratch, proj->item);
+		}
+	}
+	for (df::unit* unit : world->units.active) {
+		for (df::unit_inventory_item* held : unit->inventory) {
+			if (held->item != nullptr) {
+				push_back_counted(moving_scratch, held->item);
+			}
+		}
+	}
+	for (const minecart_info& info : minecarts) {
+		df::item* minecart_item = info.minecart_item.get();
+		if (minecart_item != nullptr) {
+			push_back_counted(moving_scratch, minecart_item);
+		}
+	}
+	item_snapshot.moving_ids.clear();
+	while (!moving_scratch.empty()) {
+		df::item* item = moving_scratch.back();
+		moving_scratch.pop_back();
+		push_back_counted(item_snapshot.moving_ids, item->id);
+		if (!full) {
+			size_t index = find_item_index(item->id);
+			if (index != items.size()) {
+				push_back_counted(snapshot_rereads, uint32_t(index));
+			}
+		}
+		Items::getContainedItems(item, &moving_contents);
+		for (df::item* contained : moving_contents) {
+			push_back_counted(moving_scratch, contained);
+		}
+	}
+	
+	std::sort(snapshot_rereads.begin(), snapshot_rereads.end());
+	snapshot_rereads.erase(std::unique(snapshot_rereads.begin(), snapshot_rereads.end()), snapshot_rereads.end());
+	for (uint32_t index : snapshot_rereads) {
+		set_snapshot_pos(item_snapshot, index, Items::getPosition(items[index]));
+	}
+}
+
+// MAX_FILTER_BOXES: the most boxes a snapshot_filter tests each position against; more z levels than this are matched exactly
+const unsigned int MAX_FILTER_BOXES = 16;
+
+struct tile_box {
+	// the bounding box of the tiles of a set on one z level
+	int16_t z;
+	int16_t min_x;
+	int16_t max_x;
+	int16_t min_y;
+	int16_t max_y;
+};
+
+struct snapshot_filter {
+	// a cheap, conservative test of whether a position may be in a set of tiles: whether it is in the box of its z level
+	tile_box boxes[MAX_FILTER_BOXES];
+	unsigned int box_count;
+	// exact: whether the tiles span too many z levels for boxes, so that positions must be looked up in the set itself
+	bool exact;
+};
+
+void build_snapshot_filter(const coord_table& tiles, snapshot_filter& filter) {
+	// fills <filter> for the tiles of <tiles>
+	filter.box_count = 0;
+	filter.exact = false;
+	for (uint32_t slot = 0; slot != tiles.size(); ++slot) {
+		df::coord pos = tiles.at(slot);
+		tile_box* box = std::find_if(
+			filter.boxes,
+			filter.boxes + filter.box_count,
+			[pos](const tile_box& b) { return b.z == pos.z; }
+		);
+		if (box == filter.boxes + filter.box_count) {
+			if (filter.box_count == MAX_FILTER_BOXES) {
+				filter.exact = true;
+				return;
+			}
+			*box = tile_box{pos.z, pos.x, pos.x, pos.y, pos.y};
+			++filter.box_count;
+		}
+		box->min_x = std::min(box->min_x, pos.x);
+		box->max_x = std::max(box->max_x, pos.x);
+		box->min_y = std::min(box->min_y, pos.y);
+		box->max_y = std::max(box->max_y, pos.y);
+	}
+}
+
+void match_snapshot(
+	const position_snapshot& snapshot,
+	const snapshot_filter& filter,
+	const coord_table& tiles,
+	size_t begin,
+	size_t end,
+	std::vector<uint32_t>& candidates
+) {
+	// appends to <candidates> the indices from <begin> to <end> - 1 of the positions of <snapshot> that pass <filter>
+	// for <tiles>; <begin> must be a multiple of SNAPSHOT_LANES
+	// candidates are a superset of the positions in <tiles>, which the caller looks up to confirm
+	if (filter.exact) {
+		for (size_t i = begin; i != end; ++i) {
+			if (tiles.find(df::coord(snapshot.x[i], snapshot.y[i], snapshot.z[i])) != coord_table::npos) {
+				candidates.push_back(uint32_t(i));
+			}
+		}
+		return;
+	}
+	
+#if defined(MINECART_FALL_LOADING_AVX2)
+	const size_t LANES = 16;
+	typedef __m256i vector_t;
+	#define SNAPSHOT_LOAD(p) _mm256_loadu_si256((const __m256i*)(p))
+	#define SNAPSHOT_SPLAT(v) _mm256_set1_epi16(v)
+	#define SNAPSHOT_EQ(a, b) _mm256_cmpeq_epi16(a, b)
+	#define SNAPSHOT_GT(a, b) _mm256_cmpgt_epi16(a, b)
+	#define SNAPSHOT_ANDNOT(a, b) _mm256_andnot_si256(a, b)
+	#define SNAPSHOT_OR(a, b) _mm256_or_si256(a, b)
+	#define SNAPSHOT_ZERO() _mm256_setzero_si256()
+	#define SNAPSHOT_MASK(v) uint32_t(_mm256_movemask_epi8(v))
+#elif defined(MINECART_FALL_LOADING_SSE2)
+	const size_t LANES = 8;
+	typedef __m128i vector_t;
+	#define SNAPSHOT_LOAD(p) _mm_loadu_si128((const __m128i*)(p))
+	#define SNAPSHOT_SPLAT(v) _mm_set1_epi16(v)
+	#define SNAPSHOT_EQ(a, b) _mm_cmpeq_epi16(a, b)
+	#define SNAPSHOT_GT(a, b) _mm_cmpgt_epi16(a, b)
+	#define SNAPSHOT_ANDNOT(a, b) _mm_andnot_si128(a, b)
+	#define SNAPSHOT_OR(a, b) _mm_or_si128(a, b)
+	#define SNAPSHOT_ZERO() _mm_setzero_si128()
+	#define SNAPSHOT_MASK(v) uint32_t(_mm_movemask_epi8(v))
+#endif
+
+#if defined(MINECART_FALL_LOADING_AVX2) || defined(MINECART_FALL_LOADING_SSE2)
+	vector_t box_z[MAX_FILTER_BOXES], box_min_x[MAX_FILTER_BOXES], box_max_x[MAX_FILTER_BOXES];
+	vector_t box_min_y[MAX_FILTER_BOXES], box_max_y[MAX_FILTER_BOXES];
+	for (unsigned int b = 0; b != filter.box_count; ++b) {
+		box_z[b] = SNAPSHOT_SPLAT(filter.boxes[b].z);
+		box_min_x[b] = SNAPSHOT_SPLAT(filter.boxes[b].min_x);
+		box_max_x[b] = SNAPSHOT_SPLAT(filter.boxes[b].max_x);
+		box_min_y[b] = SNAPSHOT_SPLAT(filter.boxes[b].min_y);
+		box_max_y[b] = SNAPSHOT_SPLAT(filter.boxes[b].max_y);
+	}
+	
+	// the arrays are padded, so the last block may be read whole; only its indices below <end> are kept
+	for (size_t i = begin; i < end; i += LANES) {
+		vector_t x = SNAPSHOT_LOAD(&snapshot.x[i]);
+		vector_t y = SNAPSHOT_LOAD(&snapshot.y[i]);
+		vector_t z = SNAPSHOT_LOAD(&snapshot.z[i]);
+		vector_t hit = SNAPSHOT_ZERO();
+		for (unsigned int b = 0; b != filter.box_count; ++b) {
+			vector_t in_box = SNAPSHOT_EQ(z, box_z[b]);
+			in_box = SNAPSHOT_ANDNOT(SNAPSHOT_GT(box_min_x[b], x), in_box);
+			in_box = SNAPSHOT_ANDNOT(SNAPSHOT_GT(x, box_max_x[b]), in_box);
+			in_box = SNAPSHOT_ANDNOT(SNAPSHOT_GT(box_min_y[b], y), in_box);
+			in_box = SNAPSHOT_ANDNOT(SNAPSHOT_GT(y, box_max_y[b]), in_box);
+			hit = SNAPSHOT_OR(hit, in_box);
+		}
+		// mask: two bits per 16-bit lane
+		uint32_t mask = SNAPSHOT_MASK(hit);
+		for (size_t lane = 0; mask != 0; ++lane, mask >>= 2) {
+			if ((mask & 1) != 0 && i + lane < end) {
+				candidates.push_back(uint32_t(i + lane));
+			}
+		}
+	}
+	
+	#undef SNAPSHOT_LOAD
+	#undef SNAPSHOT_SPLAT
+	#undef SNAPSHOT_EQ
+	#undef SNAPSHOT_GT
+	#undef SNAPSHOT_ANDNOT
+	#undef SNAPSHOT_OR
+	#undef SNAPSHOT_ZERO
+	#undef SNAPSHOT_MASK
+#else
+	for (size_t i = begin; i != end; ++i) {
+		for (unsigned int b = 0; b != filter.box_count; ++b) {
+			const tile_box& box = filter.boxes[b];
+			if (snapshot.z[i] == box.z
+				&& snapshot.x[i] >= box.min_x && snapshot.x[i] <= box.max_x
+				&& snapshot.y[i] >= box.min_y && snapshot.y[i] <= box.max_y) {
+				candidates.push_back(uint32_t(i));
+				break;
+			}
+		}
+	}
+#endif
+}
+
+
+
+// Worker threads
+// The read-only scans of an update can be split across a pool of worker threads while the game is suspended. The game's own
+// thread takes chunks too, so a pool of n - 1 workers gives n-way parallelism, and an empty pool runs everything serially.
+
+class worker_pool {
+	// fixed set of worker threads that share out the chunks of one job at a time; idle workers wait on a condition variable
+	public:
+		worker_pool();
+		~worker_pool();
+		
+		// sets the number of worker threads to <count>, starting or stopping threads as needed; must not be called during run
+		void resize(unsigned int count);
+		// returns the number of worker threads
+		unsigned int size() const;
+		// calls <task> with each chunk index in [0, <chunks>), across the workers and the calling thread; returns when all are done
+		void run(unsigned int chunks, const std::function<void(unsigned int)>& task);
+	private:
+		// runs the jobs posted after job <seen_job> until the pool is stopped
+		void work(uint64_t seen_job);
+		// runs chunks of the current job until none are left
+		void take_chunks();
+		
+		std::vector<std::thread> threads;
+		std::mutex mutex;
+		// job_ready: signalled when a job is posted or the workers are stopping
+		std::condition_variable job_ready;
+		// job_done: signalled when the last worker finishes its part of a job
+		std::condition_variable job_done;
+		// job: generation of the current job, so that each worker takes part in each job exactly once
+		uint64_t job;
+		const std::function<void(unsigned int)>* job_task;
+		unsigned int job_chunks;
+		std::atomic<unsigned int> next_chunk;
+		// busy: workers yet to finish their part of the current job
+		unsigned int busy;
+		bool stopping;
+};
+
+worker_pool::worker_pool()
+  : job(0),
+    job_task(nullptr),
+    job_chunks(0),
+    next_chunk(0),
+    busy(0),
+    stopping(false)
+{}
+
+worker_pool::~worker_pool() {
+	resize(0);
+}
+
+void worker_pool::resize(unsigned int count) {
+	if (!threads.empty()) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		job_ready.notify_all();
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+		threads.clear();
+		stopping = false;
+	}
+	// a new worker must take part in every job posted from now on, however late it starts running
+	uint64_t current_job = job;
+	for (unsigned int i = 0; i != count; ++i) {
+		threads.push_back(std::thread([this, current_job]() { work(current_job); }));
+	}
+}
+
+unsigned int worker_pool::size() const {
+	return (unsigned int)threads.size();
+}
+
+void worker_pool::run(unsigned int chunks, const std::function<void(unsigned int)>& task) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job_task = &task;
+		job_chunks = chunks;
+		next_chunk.store(0);
+		busy = (unsigned int)threads.size();
+		++job;
+	}
+	job_ready.notify_all();
+	
+	take_chunks();
+	
+	std::unique_lock<std::mutex> lock(mutex);
+	job_done.wait(lock, [this]() { return busy == 0; });
+	job_task = nullptr;
+}
+
+void worker_pool::work(uint64_t seen_job) {
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			job_ready.wait(lock, [&]() { return stopping || job != seen_job; });
+			if (stopping) {
+				return;
+			}
+			seen_job = job;
+		}
+		
+		take_chunks();
+		
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--busy == 0) {
+			job_done.notify_one();
+		}
+	}
+}
+
+void worker_pool::take_chunks() {
+	for (unsigned int chunk = next_chunk++; chunk < job_chunks; chunk = next_chunk++) {
+		(*job_task)(chunk);
+	}
+}
+
+// scan_pool: the workers among which fill_watched_tiles splits its scan of world->items.all; empty by default
+worker_pool scan_pool;
+// MAX_SCAN_THREADS: the most threads, counting the game's own, that a scan may be split across
+const unsigned int MAX_SCAN_THREADS = 64;
+
+
+
+// Watched tiles
+// The watched tiles are the tiles above each tile of each tracked minecart's predicted path. Their contents are filled once per update
+// with a single pass over the world (or from recorded events), and shared by all minecarts watching the same tile.
+// The buffers here are reused from update to update, so in the steady state they stop growing.
+
+// watched_tiles: the tiles being watched this update, each numbered with a slot
+coord_table watched_tiles;
+// tile_spans: slot of a watched tile -> the loadables recorded on that tile
+std::vector<loadable_span> tile_spans;
+// loadable_arena: the loadables recorded on all watched tiles, grouped by tile; reset at the start of every update_minecart_info
+std::vector<Loadable> loadable_arena;
+
+struct tile_match {
+	// a loadable found on a watched tile during a fill pass, before the loadables are grouped by tile
+	uint32_t slot;
+	Loadable loadable;
+};
+
+// tile_matches: the matches of the current fill pass, in the order they were found
+std::vector<tile_match> tile_matches;
+
+void record_match(df::coord pos, Loadable loadable) {
+	// records <loadable> as being on coord <pos>, if <pos> is a watched tile
+	uint32_t slot = watched_tiles.find(pos);
+	if (slot != coord_table::npos) {
+		push_back_counted(tile_matches, tile_match{slot, loadable});
+	}
+}
+
+loadable_span get_loadables_at(df::coord pos) {
+	// returns the loadables at position <pos>
+	// <pos> must be a watched tile; reflects the state of the world when the watched tiles were last filled
+	uint32_t slot = watched_tiles.find(pos);
+	if (slot == coord_table::npos || slot >= tile_spans.size()) {
+		return loadable_span{0, 0};
+	}
+	return tile_spans[slot];
+}
+
+
+void clear_watched_tiles() {
+	// stops watching every tile, forgetting the loadables recorded for them
+	watched_tiles.clear();
+	tile_spans.clear();
+	tile_matches.clear();
+	loadable_arena.clear();
+}
+
+void watch_tile(df::coord pos) {
+	// adds coord <pos> to the set of watched tiles, to be filled by the next call to fill_watched_tiles
+	watched_tiles.insert(pos);
+}
+
+void group_tile_matches() {
+	// moves the loadables found by a fill pass into loadable_arena, grouped by tile, and records each tile's span
+	// a counting sort over the slots, so O(matches + watched tiles)
+	// matches that no awake minecart wants are dropped first, whichever fill path found them
+	if (!wanted.everything) {
+		size_t found = tile_matches.size();
+		tile_matches.erase(std::remove_if(tile_matches.begin(), tile_matches.end(),
+			[](const tile_match& match) { return !match.loadable.is_wanted(); }), tile_matches.end());
+		count(COUNTER_UNWANTED, found - tile_matches.size());
+	}
+	count(COUNTER_CANDIDATES, tile_matches.size());
+	resize_counted(tile_spans, watched_tiles.size());
+	for (loadable_span& span : tile_spans) {
+		span = loadable_span{0, 0};
+	}
+	for (const tile_match& match : tile_matches) {
+		++tile_spans[match.slot].count;
+	}
+	
+	uint32_t first = 0;
+	for (loadable_span& span : tile_spans) {
+		span.first = first;
+		first += span.count;
+		// count is rebuilt below as each tile's loadables are placed
+		span.count = 0;
+	}
+	
+	resize_counted(loadable_arena, tile_matches.size());
+	for (const tile_match& match : tile_matches) {
+		loadable_span& span = tile_spans[match.slot];
+		loadable_arena[span.first + span.count] = match.loadable;
+		++span.count;
+	}
+	tile_matches.clear();
+}
+
+// SCAN_CHUNK_SIZE: objects per chunk of a parallel scan; scans of fewer than two chunks are not worth splitting
+const size_t SCAN_CHUNK_SIZE = 16384;
+// scan_chunk_size: objects per chunk of a parallel scan; SCAN_CHUNK_SIZE but in the offline fuzzer, which splits small worlds too
+// must be a multiple of SNAPSHOT_LANES, so that every chunk of a snapshot scan begins where match_snapshot can begin
+size_t scan_chunk_size = SCAN_CHUNK_SIZE;
+// chunk_matches: the matches found by each chunk of a parallel scan, merged into tile_matches in chunk order
+std::vector<std::vector<tile_match>> chunk_matches;
+// chunk_capacities: capacity of each of chunk_matches before a parallel scan, to count the growths made by the workers
+std::vector<size_t> chunk_capacities;
+
+void record_matches_in_parallel(size_t object_count, const std::function<void(size_t, size_t, std::vector<tile_match>&)>& record_range) {
+	// records the matches among <object_count> objects, split into chunks across scan_pool
+	// <record_range>(begin, end, matches) must append to matches the matches among objects begin to end - 1, and only read
+	// shared state; the matches end up in tile_matches in the same order as a serial scan would leave them
+	unsigned int chunks = (unsigned int)((object_count + scan_chunk_size - 1) / scan_chunk_size);
+	if (chunk_matches.size() < chunks) {
+		resize_counted(chunk_matches, chunks);
+		resize_counted(chunk_capacities, chunks);
+	}
+	for (unsigned int chunk = 0; chunk != chunks; ++chunk) {
+		chunk_capacities[chunk] = chunk_matches[chunk].capacity();
+	}
+	
+	scan_pool.run(chunks, [&](unsigned int chunk) {
+		std::vector<tile_match>& matches = chunk_matches[chunk];
+		matches.clear();
+		size_t begin = chunk * scan_chunk_size;
+		record_range(begin, std::min(object_count, begin + scan_chunk_size), matches);
+	});
+	
+	for (unsigned int chunk = 0; chunk != chunks; ++chunk) {
+		if (chunk_matches[chunk].capacity() != chunk_capacities[chunk]) {
+			++buffer_growths;
+		}
+		for (const tile_match& match : chunk_matches[chunk]) {
+			push_back_counted(tile_matches, match);
+		}
+	}
+}
+
+void record_item_matches(size_t begin, size_t end, std::vector<tile_match>& matches) {
+	// appends to <matches> the items from world->items.all[<begin>] to world->items.all[<end> - 1] that are on watched tiles
+	// only reads the world and watched_tiles, so may run on a worker thread
+	const std::vector<df::item*>& items = world->items.all;
+	for (size_t i = begin; i != end; ++i) {
+		uint32_t slot = watched_tiles.find(Items::getPosition(items[i]));
+		if (slot != coord_table::npos) {
+			matches.push_back(tile_match{slot, Loadable(items[i])});
+		}
+	}
+}
+
+// watched_filter: the snapshot_filter of watched_tiles, for scans of item_snapshot
+snapshot_filter watched_filter;
+
+void record_snapshot_matches(size_t begin, size_t end, std::vector<tile_match>& matches) {
+	// appends to <matches> the items from world->items.all[<begin>] to world->items.all[<end> - 1] that are on watched tiles,
+	// according to item_snapshot; only reads shared state, so may run on a worker thread
+	// candidates: the indices passing watched_filter, kept per thread so that the steady state does not allocate
+	static thread_local std::vector<uint32_t> candidates;
+	candidates.clear();
+	match_snapshot(item_snapshot, watched_filter, watched_tiles, begin, end, candidates);
+	for (uint32_t i : candidates) {
+		uint32_t slot = watched_tiles.find(df::coord(item_snapshot.x[i], item_snapshot.y[i], item_snapshot.z[i]));
+		if (slot != coord_table::npos) {
+			matches.push_back(tile_match{slot, Loadable(world->items.all[i])});
+		}
+	}
+}
+
+// Block tracking
+// Instead of a pass over all items, the items on the ground in each map_block holding a watched tile, and what they contain,
+// are kept from update to update, and only re-read when the block has changed: when the ids, positions or contents of the
+// items in block->items, or the occupancy of its tiles, are not what they were. Units and the items they hold are not kept,
+// since units move about all the time, but a unit on the ground shows in the occupancy of its tile, so the active units are
+// only gone through in an update in which one is on a watched tile; units and items in the air are found through
+// world->proj_list. An update thus costs in proportion to what is on and around the watched tiles, not to the size of the fort.
+// Items built into or held by buildings, and items more than one container deep, are not found this way.
+
+struct located_loadable {
+	// a loadable with the position it was found at
+	df::coord pos;
+	Loadable loadable;
+};
+
+struct block_record {
+	// what was found on the ground in a map_block when it was last re-read
+	// signature: get_block_signature of the block then; contents: every item on the ground in it, and what each contains
+	uint64_t signature;
+	std::vector<located_loadable> contents;
+	// last_used: the update in which the block last held a watched tile
+	uint64_t last_used;
+};
+
+// BLOCK_RECORD_IDLE_UPDATES: updates a block_record is kept for without holding a watched tile; a minecart rolls in and out of
+// the same blocks along its track, so dropping records as soon as they go unused would make and free them every few updates
+const uint64_t BLOCK_RECORD_IDLE_UPDATES = 256;
+
+// block_tracking: whether fill_watched_tiles finds items through block_records rather than a pass over all items
+bool block_tracking = false;
+// block_records: block coord (packed by pack_block_coord) -> record of the map_block's ground items
+std::unordered_map<uint64_t, block_record> block_records;
+// block_update: number of the current update, for block_record::last_used
+uint64_t block_update = 0;
+// contained_scratch: buffer for Items::getContainedItems, reused from block to block
+std::vector<df::item*> contained_scratch;
+
+inline uint64_t pack_block_coord(df::coord block) {
+	return (uint64_t(uint16_t(block.x)) << 32) | (uint64_t(uint16_t(block.y)) << 16) | uint64_t(uint16_t(block.z));
+}
+
+uint64_t get_block_signature(const df::map_block* block) {
+	// returns a value which changes when items come, go or move about on the ground of map_block <block>
+	// an order-sensitive hash of the ids, positions and contents of the items in block->items, and of which of its tiles have items
+	// the positions are needed since a minecart rolls from tile to tile without leaving block->items, and without the
+	// occupancy changing if it leaves one item's tile for another's; the contents, since an item is put in a container on the
+	// ground without the container moving
+	uint64_t signature = 0xcbf29ce484222325ull;
+	auto mix = [&signature](uint64_t value) {
+		signature = (signature ^ value) * 0x100000001b3ull;
+	};
+	mix(block->items.size());
+	for (int32_t id : block->items) {
+		mix(uint32_t(id));
+		df::item* item = df::item::find(id);
+		if (item != nullptr) {
+			mix(pack_block_coord(item->pos));
+			mix(get_contents_stamp(item));
+		}
+	}
+	for (int x = 0; x != 16; ++x) {
+		uint32_t column = 0;
+		for (int y = 0; y != 16; ++y) {
+			column = (column << 1) | (block->occupancy[x][y].bits.item ? 1 : 0);
+		}
+		mix(column);
+	}
+	return signature;
+}
+
+void read_block(const df::map_block* block, block_record& record) {
+	// re-reads into <record> the items on the ground of map_block <block>, with their contents
+	record.contents.clear();
+	for (int32_t id : block->items) {
+		df::item* item = df::item::find(id);
+		if (item == nullptr) {
+			continue;
+		}
+		df::coord pos = Items::getPosition(item);
+		push_back_counted(record.contents, located_loadable{pos, Loadable(item)});
+		contained_scratch.clear();
+		Items::getContainedItems(item, &contained_scratch);
+		for (df::item* contained : contained_scratch) {
+			push_back_counted(record.contents, located_loadable{pos, Loadable(contained)});
+		}
+	}
+}
+
+void record_block_matches() {
+	// records the items on the ground on every watched tile, with their contents, from block_records,
+	// re-reading only the map_blocks that have changed; then the units, with what they hold, and the items in the air
+	++block_update;
+	// units_on_watched: whether the occupancy shows a unit on the ground on some watched tile
+	bool units_on_watched = false;
+	for (uint32_t slot = 0; slot != watched_tiles.size(); ++slot) {
+		df::coord pos = watched_tiles.at(slot);
+		if (const df::map_block* block = get_map_block(pos)) {
+			const df::tile_occupancy& occupancy = block->occupancy[pos.x % 16][pos.y % 16];
+			units_on_watched = units_on_watched || occupancy.bits.unit || occupancy.bits.unit_grounded;
+		}
+		
+		df::coord block_coord = get_block_coord(pos);
+		block_record& record = block_records[pack_block_coord(block_coord)];
+		// a block holding several watched tiles is only gone through once
+		if (record.last_used == block_update) {
+			continue;
+		}
+		record.last_used = block_update;
+		
+		df::map_block* block = get_map_block(pos);
+		if (block == nullptr) {
+			record.contents.clear();
+			continue;
+		}
+		// a new record has signature 0, which a real block is all but certain not to have
+		uint64_t signature = get_block_signature(block);
+		if (signature != record.signature) {
+			read_block(block, record);
+			record.signature = signature;
+			count(COUNTER_BLOCKS_REFRESHED);
+			count(COUNTER_ITEMS_SCANNED, block->items.size());
+		} else {
+			count(COUNTER_BLOCKS_REUSED);
+		}
+		for (const located_loadable& found : record.contents) {
+			record_match(found.pos, found.loadable);
+		}
+	}
+	
+	for (auto iter = block_records.begin(); iter != block_records.end(); ) {
+		if (block_update - iter->second.last_used > BLOCK_RECORD_IDLE_UPDATES) {
+			iter = block_records.erase(iter);
+		} else {
+			++iter;
+		}
+	}
+	
+	// record_unit: records <unit> and what it holds, if it is on a watched tile
+	auto record_unit = [](df::unit* unit) {
+		if (watched_tiles.find(unit->pos) == coord_table::npos) {
+			return;
+		}
+		record_match(unit->pos, Loadable(unit));
+		for (df::unit_inventory_item* held : unit->inventory) {
+			if (held->item != nullptr) {
+				record_match(unit->pos, Loadable(held->item));
+			}
+		}
+	};
+	if (units_on_watched) {
+		for (df::unit* unit : world->units.active) {
+			// falling units are recorded from world->proj_list below
+			if (!unit->flags1.bits.projectile) {
+				record_unit(unit);
+			}
+		}
+		count(COUNTER_UNITS_SCANNED, world->units.active.size());
+	}
+	
+	for (df::proj_list_link* link = world->proj_list.next; link != nullptr; link = link->next) {
+		if (df::proj_itemst* proj = virtual_cast<df::proj_itemst>(link->item)) {
+			if (proj->item != nullptr) {
+				record_match(Items::getPosition(proj->item), Loadable(proj->item));
+			}
+		} else if (df::proj_unitst* proj = virtual_cast<df::proj_unitst>(link->item)) {
+			if (proj->unit != nullptr) {
+				record_unit(proj->unit);
+			}
+		}
+	}
+}
+
+void fill_watched_tiles() {
+	// records the items, units and loadables on every watched tile with a single pass over all items and all active units
+	// NOTE: item is not necessarily recorded in corresponding map_block (e.g. projectiles, contained items),
+	// so positions are taken from Items::getPosition rather than from the map_blocks
+	// with worker threads, the items are split into chunks across them; active units are far fewer, so stay serial
+	// with snapshot_refresh set, the items' positions are taken from item_snapshot instead
+	// with block_tracking set, the items and units are found through the map_blocks holding watched tiles instead
+	if (watched_tiles.size() != 0) {
+		if (block_tracking) {
+			record_block_matches();
+		} else if (snapshot_refresh != 0) {
+			refresh_item_snapshot();
+			build_snapshot_filter(watched_tiles, watched_filter);
+			if (scan_pool.size() != 0 && item_snapshot.count >= 2 * scan_chunk_size) {
+				record_matches_in_parallel(item_snapshot.count, record_snapshot_matches);
+			} else {
+				size_t capacity = tile_matches.capacity();
+				record_snapshot_matches(0, item_snapshot.count, tile_matches);
+				if (tile_matches.capacity() != capacity) {
+					++buffer_growths;
+				}
+			}
+		} else if (scan_pool.size() != 0 && world->items.all.size() >= 2 * scan_chunk_size) {
+			record_matches_in_parallel(world->items.all.size(), record_item_matches);
+		} else {
+			for (df::item* item : world->items.all) {
+				record_match(Items::getPosition(item), Loadable(item));
+			}
+		}
+		if (!block_tracking) {
+			count(COUNTER_ITEMS_SCANNED, world->items.all.size());
+			for (df::unit* unit : world->units.active) {
+				record_match(unit->pos, Loadable(unit));
+			}
+			count(COUNTER_UNITS_SCANNED, world->units.active.size());
+		}
+	}
+	
+	group_tile_matches();
+}
+
+
+enum scan_source_t {
+	// SCAN_ALL: consider every item and every active unit
+	SCAN_ALL,
+	// SCAN_PROJECTILES: consider only item projectiles and falling units
+	SCAN_PROJECTILES
+};
+
+// scan_source: which objects fill_watched_tiles_by_polling considers when polling
+scan_source_t scan_source = SCAN_PROJECTILES;
+// sweep_interval: with SCAN_PROJECTILES, every sweep_interval-th poll considers every object anyway,
+// to catch objects that reach a watched tile without being a projectile; 0 to never sweep
+unsigned int sweep_interval = 0;
+// sweep_counter: polls since the last sweep
+unsigned int sweep_counter = 0;
+
+void fill_watched_tiles_from_projectiles() {
+	// records the items, units and loadables on every watched tile, considering only objects that are in the air:
+	// the items held by world->proj_list and the active units in a falling state
+	// anything that falls onto a minecart does so as one of these, so this costs what is in the air rather than the whole fort
+	if (watched_tiles.size() != 0) {
+		for (df::proj_list_link* link = world->proj_list.next; link != nullptr; link = link->next) {
+			df::proj_itemst* proj = virtual_cast<df::proj_itemst>(link->item);
+			if (proj == nullptr || proj->item == nullptr) {
+				continue;
+			}
+			record_match(Items::getPosition(proj->item), Loadable(proj->item));
+			count(COUNTER_ITEMS_SCANNED);
+		}
+		
+		// falling units are also on world->proj_list, but the flag is cheap to check and avoids recording a unit twice
+		for (df::unit* unit : world->units.active) {
+			if (unit->flags1.bits.projectile) {
+				record_match(unit->pos, Loadable(unit));
+			}
+		}
+		count(COUNTER_UNITS_SCANNED, world->units.active.size());
+	}
+	
+	group_tile_matches();
+}
+
+bool fill_watched_tiles_by_polling() {
+	// records the items, units and loadables on every watched tile according to scan_source and sweep_interval
+	// returns whether every object was considered, rather than only those in the air
+	bool sweep = false;
+	if (scan_source == SCAN_PROJECTILES && sweep_interval != 0) {
+		++sweep_counter;
+		if (sweep_counter >= sweep_interval) {
+			sweep_counter = 0;
+			sweep = true;
+		}
+	}
+	PLUGIN_LOG(LEVEL_TRACE, CATEGORY_WATCH, "fill_watched_tiles_by_polling: sweep: {}", sweep);
+	
+	if (scan_source == SCAN_ALL || sweep) {
+		fill_watched_tiles();
+		return true;
+	}
+	fill_watched_tiles_from_projectiles();
+	return false;
+}
+
+
+
+// Event-driven detection
+// Instead of scanning the world every tick, projectile movement can be interposed so that items and units entering a watched
+// tile are recorded as they move; update_minecart_info then only has to look at the recorded objects. The interposes check
+// against the tiles watched by the last update, so when an update watches a tile that was not watched before, what is already
+// in the air is gone through once to find the objects on it.
+// Polling (fill_watched_tiles) stays the default until the interposes have been verified in live forts; events are opted into
+// with the plugin's console command.
+
+enum detection_mode_t {
+	// DETECTION_POLLING: scan all items and units every update
+	DETECTION_POLLING,
+	// DETECTION_EVENTS: record objects as their projectiles move, via vmethod interposes
+	DETECTION_EVENTS
+};
+
+// detection_mode: how watched tiles are filled
+detection_mode_t detection_mode = DETECTION_POLLING;
+
+// event_candidates: objects seen entering a watched tile since they were last examined by fill_watched_tiles_from_events
+// objects stay recorded for as long as they remain on a watched tile, since a projectile can linger on a tile for several ticks
+// may contain duplicates until fill_watched_tiles_from_events removes them
+std::vector<Loadable> event_candidates;
+// event_watched_tiles: the tiles watched when fill_watched_tiles_from_events last ran, which the interposes have checked since
+coord_table event_watched_tiles;
+
+void note_item_moved(df::item* item) {
+	// records item <item>, which has just moved as a projectile, if it is now on a watched tile
+	if (watched_tiles.find(Items::getPosition(item)) != coord_table::npos) {
+		push_back_counted(event_candidates, Loadable(item));
+	}
+}
+
+void note_unit_moved(df::unit* unit) {
+	// records unit <unit>, which has just moved as a projectile, if it is now on a watched tile
+	if (watched_tiles.find(unit->pos) != coord_table::npos) {
+		push_back_counted(event_candidates, Loadable(unit));
+	}
+}
+
+bool is_in_air(const Loadable& loadable) {
+	// returns whether the object of <loadable> still exists and is in the air
+	if (loadable.kind() == Loadable::ITEM) {
+		df::item* item = loadable.item();
+		return item != nullptr && is_falling(item);
+	}
+	df::unit* unit = loadable.unit();
+	return unit != nullptr && unit->flags1.bits.projectile;
+}
+
+struct proj_item_hook : df::proj_itemst {
+	// interposes item projectile movement to record items entering watched tiles
+	typedef df::proj_itemst interpose_base;
+	
+	DEFINE_VMETHOD_INTERPOSE(bool, checkMovement, ()) {
+		// the projectile may be finished with after the call, so hold on to the item rather than this
+		df::item* moved = item;
+		bool out = INTERPOSE_NEXT(checkMovement)();
+		if (moved != nullptr) {
+			note_item_moved(moved);
+		}
+		return out;
+	}
+};
+
+IMPLEMENT_VMETHOD_INTERPOSE(proj_item_hook, checkMovement);
+
+struct proj_unit_hook : df::proj_unitst {
+	// interposes unit projectile movement to record units entering watched tiles
+	typedef df::proj_unitst interpose_base;
+	
+	DEFINE_VMETHOD_INTERPOSE(bool, checkMovement, ()) {
+		// the projectile may be finished with after the call, so hold on to the unit rather than this
+		df::unit* moved = unit;
+		bool out = INTERPOSE_NEXT(checkMovement)();
+		if (moved != nullptr) {
+			note_unit_moved(moved);
+		}
+		return out;
+	}
+};
+
+IMPLEMENT_VMETHOD_INTERPOSE(proj_unit_hook, checkMovement);
+
+void apply_event_hooks(bool enable) {
+	// installs (<enable> true) or removes (<enable> false) the projectile movement interposes
+	PLUGIN_LOG(LEVEL_INFO, CATEGORY_GENERAL, "apply_event_hooks: enable: {}", enable);
+	INTERPOSE_HOOK(proj_item_hook, checkMovement).apply(enable);
+	INTERPOSE_HOOK(proj_unit_hook, checkMovement).apply(enable);
+	if (!enable) {
+		event_candidates.clear();
+	}
+}
+
+void set_detection_mode(detection_mode_t mode) {
+	// switches how watched tiles are filled, installing or removing the movement interposes as needed
+	// the interposes are only installed while a map is loaded
+	if (active) {
+		apply_event_hooks(mode == DETECTION_EVENTS);
+	}
+	// nothing has been checked against the tiles watched so far
+	event_watched_tiles.clear();
+	detection_mode = mode;
+}
+
+void note_objects_in_air() {
+	// records the objects in the air that are on a watched tile, as if each had just moved: the items held by world->proj_list
+	// and the active units in a falling state
+	for (df::proj_list_link* link = world->proj_list.next; link != nullptr; link = link->next) {
+		df::proj_itemst* proj = virtual_cast<df::proj_itemst>(link->item);
+		if (proj != nullptr && proj->item != nullptr) {
+			note_item_moved(proj->item);
+			count(COUNTER_ITEMS_SCANNED);
+		}
+	}
+	for (df::unit* unit : world->units.active) {
+		if (unit->flags1.bits.projectile) {
+			note_unit_moved(unit);
+		}
+	}
+	count(COUNTER_UNITS_SCANNED, world->units.active.size());
+}
+
+void fill_watched_tiles_from_events() {
+	// records the items, units and loadables on every watched tile from the objects recorded by the movement interposes
+	// objects no longer on a watched tile, or no longer in the air, are forgotten; they will be recorded again if they move
+	// onto one as projectiles
+	// newly_watched: whether a tile is watched that the interposes have not been checking against
+	bool newly_watched = false;
+	for (uint32_t slot = 0; slot != watched_tiles.size() && !newly_watched; ++slot) {
+		newly_watched = event_watched_tiles.find(watched_tiles.at(slot)) == coord_table::npos;
+	}
+	if (newly_watched) {
+		note_objects_in_air();
+	}
+	event_watched_tiles.clear();
+	for (uint32_t slot = 0; slot != watched_tiles.size(); ++slot) {
+		event_watched_tiles.insert(watched_tiles.at(slot));
+	}
+	
+	std::sort(event_candidates.begin(), event_candidates.end());
+	event_candidates.erase(std::unique(event_candidates.begin(), event_candidates.end()), event_candidates.end());
+	
+	// kept: number of candidates still on a watched tile, compacted to the front of event_candidates
+	size_t kept = 0;
+	count(COUNTER_ITEMS_SCANNED, event_candidates.size());
+	for (size_t i = 0; i != event_candidates.size(); ++i) {
+		Loadable candidate = event_candidates[i];
+		df::coord pos = candidate.pos();
+		if (watched_tiles.find(pos) != coord_table::npos && is_in_air(candidate)) {
+			record_match(pos, candidate);
+			event_candidates[kept] = candidate;
+			++kept;
+		}
+	}
+	event_candidates.resize(kept);
+	
+	group_tile_matches();
+}
+
+minecart_info make_minecart_info(df::vehicle* minecart) {
+	// returns a new info record for minecart <minecart>
+	// will be properly initialized later in the update, during the call to update_minecart_info
+	minecart_info out;
+	out.id = minecart->id;
+	out.minecart = minecart;
+	df::item* minecart_item = get_minecart_item(minecart);
+	out.minecart_item = handle<df::item>(minecart_item);
+	out.pos = df::coord();
+	out.path_length = 0;
+	out.path_motion = cart_motion();
+	out.path_tick = 0;
+	// a vehicle may outlive its minecart item, in which case the minecart is skipped until it is dropped from the list
+	out.load_capacity = minecart_item != nullptr ? get_item_load_capacity(minecart_item) : 0;
+	out.loaded_volume = minecart_item != nullptr ? get_item_loaded_volume(minecart_item) : 0;
+	out.contents_stamp = minecart_item != nullptr ? get_contents_stamp(minecart_item) : 0;
+	out.asleep = false;
+	out.idle_updates = 0;
+	out.activity_stamp = 0;
+	std::fill(out.above_path, out.above_path + MAX_PATH_TILES, loadable_span{0, 0});
+	std::fill(out.incoming_path, out.incoming_path + MAX_PATH_TILES, loadable_span{0, 0});
+	out.filter = nullptr;
+	out.filter_route = -1;
+	// never a current generation, so that the filter is resolved before first use
+	out.filter_generation = 0;
+	return out;
+}
+
+
+
+// Scheduling
+// A minecart that stays stationary with nothing above it for sleep_after updates is put to sleep: its tiles are no longer watched
+// and it only gets a wake check per update. It wakes when it moves or gains speed, when the contents of the map_block above it
+// change, or when a projectile is in that map_block or in one it could fall from before the next update; the check is O(levels
+// any projectile can fall in update_interval ticks).
+
+// update_interval: number of ticks between updates when active
+unsigned int update_interval = 1;
+// sleep_after: number of consecutive idle updates after which a minecart is put to sleep; 0 to never sleep
+unsigned int sleep_after = 20;
+
+// projectile_blocks: the map_blocks (as block coords: x and y divided by 16) holding a projectile, found once per update
+// only filled when some minecart is asleep or the occupancy prefilter is in use
+coord_table projectile_blocks;
+// wake_levels: the most levels any projectile in projectile_blocks can fall before the next update, plus one; found with it
+int32_t wake_levels = 1;
+// occupancy_prefilter: whether, when polling, tiles that the map_block occupancy shows to be empty are left unwatched
+bool occupancy_prefilter = true;
+
+uint64_t get_activity_stamp(df::coord pos) {
+	// returns a value which changes when items or units come or go on coord <pos>, or items come or go in its map_block
+	df::map_block* block = get_map_block(pos);
+	if (block == nullptr) {
+		return 0;
+	}
+	const df::tile_occupancy& occupancy = block->occupancy[pos.x % 16][pos.y % 16];
+	uint64_t tile_bits = (occupancy.bits.item ? 1 : 0) | (occupancy.bits.unit ? 2 : 0) | (occupancy.bits.unit_grounded ? 4 : 0);
+	return (uint64_t(block->items.size()) << 3) | tile_bits;
+}
+
+bool is_prefiltering() {
+	// returns whether the occupancy prefilter applies to this update
+	// with events, the watched tiles are where arrivals are noticed until the next update, so an empty tile must still be watched
+	return occupancy_prefilter && detection_mode == DETECTION_POLLING;
+}
+
+int32_t estimate_fall_levels(const df::projectile* projectile, unsigned int ticks) {
+	// returns the estimated number of levels <projectile> falls within <ticks> ticks; the converse of estimate_fall_ticks
+	if (projectile->flags.bits.parabolic) {
+		int64_t drop = 0;
+		int64_t speed = projectile->speed_z;
+		for (unsigned int tick = 0; tick != ticks; ++tick) {
+			speed += projectile->accel_z;
+			drop -= speed;
+		}
+		return int32_t(std::max<int64_t>((drop + 99999) / 100000, 0));
+	}
+	int64_t counter = std::max<int16_t>(projectile->fall_counter, 0);
+	if (int64_t(ticks) <= counter) {
+		return 0;
+	}
+	return int32_t(1 + (int64_t(ticks) - counter - 1) / (std::max<int16_t>(projectile->fall_delay, 0) + 1));
+}
+
+void find_projectile_blocks() {
+	// fills projectile_blocks and wake_levels from world->proj_list, if any minecart is asleep or the occupancy prefilter applies
+	projectile_blocks.clear();
+	wake_levels = 1;
+	
+	bool any_asleep = std::any_of(
+		minecarts.begin(),
+		minecarts.end(),
+		[](const minecart_info& info) { return info.asleep; }
+	);
+	if (!any_asleep && !is_prefiltering()) {
+		return;
+	}
+	
+	for (df::proj_list_link* link = world->proj_list.next; link != nullptr; link = link->next) {
+		if (link->item != nullptr) {
+			projectile_blocks.insert(get_block_coord(link->item->cur_pos));
+			wake_levels = std::max(wake_levels, estimate_fall_levels(link->item, update_interval) + 1);
+		}
+	}
+}
+
+bool may_hold_loadable(df::coord pos) {
+	// returns whether there may be an item or unit on coord <pos>, from its map_block's occupancy; conservative
+	// projectiles do not necessarily show up in the occupancy, so any tile in a map_block holding one may hold something
+	df::map_block* block = get_map_block(pos);
+	if (block == nullptr) {
+		return false;
+	}
+	if (projectile_blocks.find(get_block_coord(pos)) != coord_table::npos) {
+		return true;
+	}
+	// items built into or held by a building are positioned on it without necessarily setting the item bit
+	const df::tile_occupancy& occupancy = block->occupancy[pos.x % 16][pos.y % 16];
+	return occupancy.bits.item || occupancy.bits.unit || occupancy.bits.unit_grounded || occupancy.bits.building != df::tile_building_occ::None;
+}
+
+bool is_idle(const minecart_info& info) {
+	// returns whether the minecart of <info> is stationary with nothing recorded above it or falling toward it
+	const df::vehicle* minecart = info.minecart;
+	auto is_empty = [](loadable_span span) { return span.count == 0; };
+	return minecart->speed_x == 0 && minecart->speed_y == 0 && minecart->speed_z == 0
+		&& info.path_length == 1
+		&& std::all_of(info.above_path, info.above_path + info.path_length, is_empty)
+		&& std::all_of(info.incoming_path, info.incoming_path + info.path_length, is_empty);
+}
+
+bool should_wake(const minecart_info& info, df::coord current_pos) {
+	// returns whether the sleeping minecart of <info>, now at <current_pos>, needs to be woken
+	const df::vehicle* minecart = info.minecart;
+	if (minecart->speed_x != 0 || minecart->speed_y != 0 || minecart->speed_z != 0 || current_pos != info.pos) {
+		return true;
+	}
+	
+	df::coord above = current_pos + df::coord(0, 0, 1);
+	if (get_activity_stamp(above) != info.activity_stamp) {
+		return true;
+	}
+	
+	// projectiles do not necessarily show up in the map_block, so check for them separately;
+	// every map_block from which a projectile could fall into the tile above before the next update is checked too, so that the
+	// minecart is woken before the object gets there
+	for (int32_t levels = 0; levels <= wake_levels; ++levels) {
+		if (projectile_blocks.find(get_block_coord(above + df::coord(0, 0, levels))) != coord_table::npos) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void update_sleep_state(minecart_info& info) {
+	// puts the awake minecart of <info> to sleep if it has been idle for sleep_after consecutive updates
+	if (sleep_after == 0 || !is_idle(info)) {
+		info.idle_updates = 0;
+		return;
+	}
+	
+	++info.idle_updates;
+	if (info.idle_updates >= sleep_after) {
+		PLUGIN_LOG(LEVEL_DEBUG, CATEGORY_SCHEDULE, "minecart {} falls asleep at {}", info.id, info.pos);
+		info.asleep = true;
+		info.activity_stamp = get_activity_stamp(info.pos + df::coord(0, 0, 1));
+	}
+}
+
+
+
+// Column lookahead
+// Dump shafts are often tens of levels tall, and between two updates an object falling down one may pass the tile above a
+// minecart's path without ever being seen on it. So falling objects are also followed down the column above each path tile:
+// every update, each projectile up to column_height levels above a path tile is staged for the nearest one below it, with the
+// tick it is estimated to land and, for items, its volume already resolved. A staged object that has landed on a tile the
+// minecart has since crossed, on an estimated tick when the path had the minecart on that tile, is then loaded like one seen on
+// the tile above, with only the capacity left to compare. The column above a sleeping minecart is followed too, and anything
+// staged in it wakes the minecart.
+// Only projectiles are followed, since nothing else descends, so this costs column_height lookups per projectile.
+
+// MAX_COLUMN_HEIGHT: the most levels above a path tile that can be followed
+const unsigned int MAX_COLUMN_HEIGHT = 64;
+// MAX_FALL_TICKS: the longest fall that is estimated; longer ones are estimated as this
+const int32_t MAX_FALL_TICKS = 1000;
+
+// column_height: number of levels above each path tile in which projectiles are followed, counting the tile above it,
+// which is watched anyway; 1 or less to follow none beyond it
+unsigned int column_height = 30;
+
+struct incoming_load {
+	// a falling object staged to land on a path tile
+	Loadable loadable;
+	// arrival_tick: world->frame_counter on which it is estimated to land
+	int32_t arrival_tick;
+	// volume: the item's volume, for items; 0 for units
+	int32_t volume;
+};
+
+// column_bases: the path tiles whose columns are followed this update, each numbered with a slot
+coord_table column_bases;
+// column_spans: slot of a path tile -> the objects staged to land on it
+std::vector<loadable_span> column_spans;
+// incoming_arena: the objects staged on all path tiles, grouped by tile; reset at the start of every update_minecart_info
+std::vector<incoming_load> incoming_arena;
+
+struct column_match {
+	// an object staged for a path tile, before the staged objects are grouped by tile
+	uint32_t slot;
+	incoming_load incoming;
+};
+
+// column_matches: the objects staged this update, in the order they were found
+std::vector<column_match> column_matches;
+
+void clear_columns() {
+	// stops following every column, forgetting the objects staged in them
+	column_bases.clear();
+	column_spans.clear();
+	column_matches.clear();
+	incoming_arena.clear();
+}
+
+void follow_column(df::coord base) {
+	// adds the column above path tile <base> to those followed by the next call to fill_columns
+	if (column_height > 1) {
+		column_bases.insert(base);
+	}
+}
+
+int32_t estimate_fall_ticks(const df::projectile* projectile, int32_t levels) {
+	// returns the estimated number of ticks before <projectile> has fallen <levels> levels
+	// a parabolic projectile moves by its speed, in 1/100000ths of a tile, which its acceleration changes every tick;
+	// any other drops a level each time its fall_counter runs out, after which it counts down from fall_delay again
+	if (projectile->flags.bits.parabolic) {
+		int64_t drop = 0;
+		int64_t speed = projectile->speed_z;
+		for (int32_t ticks = 1; ticks != MAX_FALL_TICKS; ++ticks) {
+			speed += projectile->accel_z;
+			drop -= speed;
+			if (drop >= int64_t(levels) * 100000) {
+				return ticks;
+			}
+		}
+		return MAX_FALL_TICKS;
+	}
+	int64_t ticks = int64_t(std::max<int16_t>(projectile->fall_counter, 0)) + 1
+		+ int64_t(levels - 1) * (std::max<int16_t>(projectile->fall_delay, 0) + 1);
+	return int32_t(std::min<int64_t>(ticks, MAX_FALL_TICKS));
+}
+
+int32_t get_landing_tick(const minecart_info& info, int32_t arrival_tick, int32_t now) {
+	// returns the tick after info.path_tick on which an object staged to land on tick <arrival_tick>, and found landed on tick
+	// <now>, is taken to have landed: its estimate, brought within the ticks since the path was recorded, since one estimated
+	// to land after <now> has landed early, so by <now> at the latest
+	int32_t elapsed = std::max<int32_t>(now - info.path_tick, 1);
+	return std::min(std::max<int32_t>(arrival_tick - info.path_tick, 1), elapsed);
+}
+
+void stage_incoming(df::coord base, const incoming_load& incoming) {
+	// stages <incoming> to land on path tile <base>, if its column is followed
+	uint32_t slot = column_bases.find(base);
+	if (slot != coord_table::npos) {
+		push_back_counted(column_matches, column_match{slot, incoming});
+	}
+}
+
+void group_column_matches() {
+	// moves the staged objects into incoming_arena, grouped by path tile and soonest to land first, and records each tile's span
+	// there are only as many as there are projectiles above paths, so a sort is cheap enough
+	std::sort(column_matches.begin(), column_matches.end(), [](const column_match& a, const column_match& b) {
+		if (a.slot != b.slot) {
+			return a.slot < b.slot;
+		}
+		if (a.incoming.arrival_tick != b.incoming.arrival_tick) {
+			return a.incoming.arrival_tick < b.incoming.arrival_tick;
+		}
+		return a.incoming.loadable < b.incoming.loadable;
+	});
+	
+	resize_counted(column_spans, column_bases.size());
+	for (loadable_span& span : column_spans) {
+		span = loadable_span{0, 0};
+	}
+	resize_counted(incoming_arena, column_matches.size());
+	for (uint32_t i = 0; i != column_matches.size(); ++i) {
+		loadable_span& span = column_spans[column_matches[i].slot];
+		if (span.count == 0) {
+			span.first = i;
+		}
+		++span.count;
+		incoming_arena[i] = column_matches[i].incoming;
+	}
+	column_matches.clear();
+}
+
+void fill_columns() {
+	// stages each projectile in a followed column for the nearest followed path tile below it
+	// a projectile right above a path tile is on a watched tile, so is left to the watched tiles
+	if (column_bases.size() != 0) {
+		int32_t now = world->frame_counter;
+		for (df::proj_list_link* link = world->proj_list.next; link != nullptr; link = link->next) {
+			df::projectile* projectile = link->item;
+			incoming_load incoming = incoming_load();
+			df::coord pos;
+			if (df::proj_itemst* proj = virtual_cast<df::proj_itemst>(projectile)) {
+				if (proj->item == nullptr) {
+					continue;
+				}
+				incoming.loadable = Loadable(proj->item);
+				pos = Items::getPosition(proj->item);
+			} else if (df::proj_unitst* proj = virtual_cast<df::proj_unitst>(projectile)) {
+				if (proj->unit == nullptr) {
+					continue;
+				}
+				incoming.loadable = Loadable(proj->unit);
+				pos = proj->unit->pos;
+			} else {
+				continue;
+			}
+			
+			for (unsigned int levels = 1; levels <= column_height; ++levels) {
+				df::coord base = pos - df::coord(0, 0, int16_t(levels));
+				if (column_bases.find(base) == coord_table::npos) {
+					continue;
+				}
+				if (levels != 1) {
+					incoming.arrival_tick = now + estimate_fall_ticks(projectile, int32_t(levels));
+					incoming.volume = incoming.loadable.kind() == Loadable::ITEM ? incoming.loadable.item()->getVolume() : 0;
+					stage_incoming(base, incoming);
+					count(COUNTER_INCOMING_STAGED);
+					PLUGIN_LOG(LEVEL_TRACE, CATEGORY_WATCH, "fill_columns: loadable of kind {} {} levels above {}, estimated to land at tick {}",
+						int(incoming.loadable.kind()), levels, base, incoming.arrival_tick);
+				}
+				break;
+			}
+		}
+	}
+	
+	group_column_matches();
+}
+
+loadable_span get_incoming_at(df::coord base) {
+	// returns the objects staged to land on path tile <base>, as a span of incoming_arena
+	// reflects the state of the world when the columns were last filled
+	uint32_t slot = column_bases.find(base);
+	if (slot == coord_table::npos || slot >= column_spans.size()) {
+		return loadable_span{0, 0};
+	}
+	return column_spans[slot];
+}
+
+
+
+
+// Pipelined prediction
+// With pipelining on, the next update's paths and watched tiles are planned on a background thread while the game runs, from
+// a snapshot taken at the end of each update of every awake minecart's path and motion, copied out into plain data so that the
+// planner never reads DF's objects: each minecart is moved on by update_interval ticks at its current speed and its path
+// advanced from there. A path swept from a tile depends only on the motion and the horizon, so the next update takes the
+// planned path as it is, without advancing its own, for each minecart found on the tile and with the offsets and speed
+// planned. Any other minecart still advances its path from where it really is, and has it checked against the tiles planned:
+// when they are the same, they are watched and their columns followed already. Otherwise the plan is missed, and its tiles are
+// released before the minecart's real path is watched, as are those of plans for minecarts no longer awake, so that the
+// watched tiles are always just those above the real paths and updates decide the same either way.
+// The planner only runs while the plugin is otherwise idle: every entry point first waits for it by finish_plan, which also
+// records the time the plan took, so that the stats are only ever written by the game's thread. Filling the watched tiles
+// reads the map, so stays under the game lock, and since the occupancy prefilter reads it too, nothing is planned while it
+// applies.
+
+class background_worker {
+	// a single thread that runs posted jobs one at a time, while the thread that posted them goes on
+	public:
+		background_worker();
+		~background_worker();
+		
+		// starts (<run> true) or stops the thread, finishing any posted job first
+		void set_running(bool run);
+		// returns whether the thread is running
+		bool is_running() const;
+		// runs <task> on the thread, or at once on the calling thread if it is not running; the last job must be finished
+		void post(const std::function<void()>& task);
+		// returns once the last posted job has finished
+		void wait();
+	private:
+		// runs the posted jobs until stopped
+		void work();
+		
+		std::thread thread;
+		std::mutex mutex;
+		// job_ready: signalled when a job is posted or the thread is stopping
+		std::condition_variable job_ready;
+		// job_done: signalled when a job has finished
+		std::condition_variable job_done;
+		std::function<void()> job;
+		// pending: whether job has been posted and has not yet finished
+		bool pending;
+		bool stopping;
+};
+
+background_worker::background_worker()
+  : pending(false),
+    stopping(false)
+{}
+
+background_worker::~background_worker() {
+	set_running(false);
+}
+
+void background_worker::set_running(bool run) {
+	if (run == thread.joinable()) {
+		return;
+	}
+	if (run) {
+		thread = std::thread([this]() { work(); });
+		return;
+	}
+	wait();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	job_ready.notify_one();
+	thread.join();
+	stopping = false;
+}
+
+bool background_worker::is_running() const {
+	return thread.joinable();
+}
+
+void background_worker::post(const std::function<void()>& task) {
+	if (!thread.joinable()) {
+		task();
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = task;
+		pending = true;
+	}
+	job_ready.notify_one();
+}
+
+void background_worker::wait() {
+	std::unique_lock<std::mutex> lock(mutex);
+	job_done.wait(lock, [this]() { return !pending; });
+}
+
+void background_worker::work() {
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			job_ready.wait(lock, [this]() { return stopping || pending; });
+			if (stopping) {
+				return;
+			}
+		}
+		
+		job();
+		
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			pending = false;
+		}
+		job_done.notify_all();
+	}
+}
+
+// pipelining: whether the next update's paths are planned in the background
+bool pipelining = false;
+// planner: the thread the plans are made on; only running while pipelining
+background_worker planner;
+
+struct cart_plan {
+	// an awake minecart's path and motion; as snapshotted at the end of an update, then as planned for the next update
+	minecart_id_t id;
+	// pos, motion: where the minecart is and how it moves, or is predicted to at the next update
+	df::coord pos;
+	cart_motion motion;
+	// path, path_length, path_motion: as in minecart_info; once planned, advanced from pos
+	df::coord path[MAX_PATH_TILES];
+	unsigned int path_length;
+	cart_motion path_motion;
+	// settled: whether the update the plan is for has kept or released it
+	bool settled;
+};
+
+// plan_interval, plan_horizon, plan_follows_columns: the update_interval, path horizon and whether columns were followed, as
+// the plan was made with; a plan made with other settings than the update's is not used
+unsigned int plan_interval = 0;
+unsigned int plan_horizon = 0;
+bool plan_follows_columns = false;
+// cart_plans: the awake minecarts at the end of the last update, planned in place by plan_next_update, in ascending order of id
+std::vector<cart_plan> cart_plans;
+// plan_cursor: index into cart_plans of the next plan that update_minecart_info may look for; minecarts are in the same order
+size_t plan_cursor = 0;
+// planned_watched_tiles, planned_column_bases: the tiles to watch and columns to follow by the plans; swapped with
+// watched_tiles and column_bases when taken, so neither is ever reallocated in the steady state
+coord_table planned_watched_tiles;
+coord_table planned_column_bases;
+// plan_posted: whether a plan for the next update has been posted to planner
+bool plan_posted = false;
+// plan_ns, plan_timed: how long plan_next_update took, and whether it has yet to be recorded in stats; written on planner,
+// and read by finish_plan once it has waited for it
+uint64_t plan_ns = 0;
+bool plan_timed = false;
+
+void predict_motion(cart_motion& motion, df::coord& pos, unsigned int ticks) {
+	// moves a minecart moving as <motion>, on coord <pos>, on by <ticks> ticks at its current speed, as get_predicted_pos
+	// would predict, carrying the whole tiles of its offsets into <pos>
+	auto move = [ticks](int32_t& offset, int32_t speed, int16_t& coord) {
+		int64_t moved = offset + int64_t(speed) * ticks;
+		int64_t tiles = div_floor(moved + 50000, 100000);
+		offset = int32_t(moved - tiles * 100000);
+		coord = int16_t(coord + tiles);
+	};
+	move(motion.offset_x, motion.speed_x, pos.x);
+	move(motion.offset_y, motion.speed_y, pos.y);
+	move(motion.offset_z, motion.speed_z, pos.z);
+}
+
+void plan_next_update() {
+	// plans the next update's path for each minecart in cart_plans, and the tiles to watch and columns to follow for them
+	// runs on planner while the game runs, so must only touch the plan's own state, and is timed into plan_ns rather than stats
+	auto start = std::chrono::steady_clock::now();
+	planned_watched_tiles.clear();
+	planned_column_bases.clear();
+	
+	for (cart_plan& plan : cart_plans) {
+		predict_motion(plan.motion, plan.pos, plan_interval);
+		plan.path_length = advance_path(plan.path, plan.path_length, plan.path_motion, plan.pos, plan.motion, plan_horizon);
+		plan.path_motion = plan.motion;
+		for (unsigned int j = 0; j != plan.path_length; ++j) {
+			if (plan_follows_columns) {
+				planned_column_bases.insert(plan.path[j]);
+			}
+			planned_watched_tiles.insert(plan.path[j] + df::coord(0, 0, 1));
+		}
+	}
+	
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	plan_ns = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+	plan_timed = true;
+}
+
+void post_plan(unsigned int horizon_ticks) {
+	// snapshots the awake minecarts and posts the planning of their paths, for <horizon_ticks> ticks, for the next update
+	// called at the end of an update, if pipelining
+	plan_posted = false;
+	if (is_prefiltering()) {
+		return;
+	}
+	
+	cart_plans.clear();
+	for (const minecart_info& info : minecarts) {
+		if (info.asleep || info.path_length == 0) {
+			continue;
+		}
+		cart_plan plan;
+		plan.id = info.id;
+		plan.pos = info.pos;
+		plan.motion = get_motion(info.minecart);
+		std::copy(info.path, info.path + info.path_length, plan.path);
+		plan.path_length = info.path_length;
+		plan.path_motion = info.path_motion;
+		plan.settled = false;
+		push_back_counted(cart_plans, plan);
+	}
+	
+	plan_interval = update_interval;
+	plan_horizon = horizon_ticks;
+	plan_follows_columns = column_height > 1;
+	planner.post(plan_next_update);
+	plan_posted = true;
+}
+
+void finish_plan() {
+	// waits for the plan being made, if any, to be finished, and records how long it took; to be called before the plugin does
+	// anything else
+	planner.wait();
+	if (plan_timed) {
+		stats.phases[PHASE_PLAN_NEXT_UPDATE].record(plan_ns);
+		plan_timed = false;
+	}
+}
+
+bool take_plan(unsigned int horizon_ticks) {
+	// if a plan for this update was made with the current settings, begins the update's watched tiles and followed columns
+	// with those it planned, and returns true; otherwise returns false, and the caller must clear them itself
+	bool usable = plan_posted && !is_prefiltering() && plan_interval == update_interval && plan_horizon == horizon_ticks
+		&& plan_follows_columns == (column_height > 1);
+	plan_posted = false;
+	if (!usable) {
+		return false;
+	}
+	clear_watched_tiles();
+	std::swap(watched_tiles, planned_watched_tiles);
+	clear_columns();
+	std::swap(column_bases, planned_column_bases);
+	plan_cursor = 0;
+	return true;
+}
+
+cart_plan* find_plan(minecart_id_t id) {
+	// returns the plan of the minecart with id <id>, or nullptr if it has none
+	// minecarts are looked for in ascending order of id, so this walks cart_plans once per update
+	while (plan_cursor != cart_plans.size() && cart_plans[plan_cursor].id < id) {
+		++plan_cursor;
+	}
+	if (plan_cursor != cart_plans.size() && cart_plans[plan_cursor].id == id) {
+		return &cart_plans[plan_cursor];
+	}
+	return nullptr;
+}
+
+bool follows_plan(const cart_plan& plan, df::coord current_pos, const cart_motion& motion) {
+	// returns whether a minecart now at <current_pos> and moving as <motion> is where and as <plan> predicted, so that the path
+	// planned is the one advance_path would give it
+	return plan.pos == current_pos && same_motion(plan.motion, motion);
+}
+
+void take_planned_path(minecart_info& info, cart_plan& plan) {
+	// gives the minecart of <info> the path of <plan>, which it follows, in place of advancing its own
+	std::copy(plan.path, plan.path + plan.path_length, info.path);
+	info.path_length = plan.path_length;
+	info.path_motion = plan.path_motion;
+	plan.settled = true;
+}
+
+bool sweeps_plan(const minecart_info& info, const cart_plan& plan) {
+	// returns whether the path just advanced for the minecart of <info> has the same tiles as <plan>, whose tiles are then
+	// watched and columns followed already, however far the minecart's offsets or speed are from those predicted
+	return info.path_length == plan.path_length && std::equal(info.path, info.path + info.path_length, plan.path);
+}
+
+void release_plan(cart_plan& plan) {
+	// stops watching the tiles and following the columns <plan> added, unless some other path added them too
+	for (unsigned int i = 0; i != plan.path_length; ++i) {
+		if (plan_follows_columns) {
+			column_bases.release(plan.path[i]);
+		}
+		watched_tiles.release(plan.path[i] + df::coord(0, 0, 1));
+	}
+	plan.settled = true;
+}
+
+void release_unsettled_plans() {
+	// releases the plans of the minecarts that the update did not get to check against them, as ones gone or asleep
+	for (cart_plan& plan : cart_plans) {
+		if (!plan.settled) {
+			release_plan(plan);
+		}
+	}
+}
+
+void set_pipelining(bool enable) {
+	// turns pipelining on or off, starting or stopping the planner thread
+	planner.set_running(enable);
+	pipelining = enable;
+	plan_posted = false;
+}
+
+
+
+// Verification
+// An opt-in check, for the optimised ways of filling the watched tiles: after every fill, the contents recorded for each
+// watched tile are compared against a deliberately naive reference, a brute-force pass over the objects kept in an ordered map,
+// sharing none of the indexing. Mismatches are counted in the stats and logged under the verify category.
+// The same comparison drives the fuzzer of the offline target, offline/minecart_fall_loading_offline.cpp, which runs the update
+// functions over random synthetic worlds rather than the fort's own.
+
+// verify_enabled: whether every update's fill is checked against the reference
+bool verify_enabled = false;
+
+struct verify_object {
+	// an object considered by the reference, with its position
+	df::coord pos;
+	Loadable loadable;
+};
+
+// verify_objects: the objects considered by the reference this update; reused from update to update
+std::vector<verify_object> verify_objects;
+
+unsigned int verify_watched_tiles(const std::vector<minecart_info>& carts, const std::vector<verify_object>& objects) {
+	// compares the recorded contents of the tiles above the paths of the awake minecarts in <carts>
+	// with the objects of <objects> that are on them; returns the number of tiles that differ
+	std::map<df::coord, std::vector<Loadable>> expected;
+	for (const minecart_info& info : carts) {
+		if (info.asleep) {
+			continue;
+		}
+		for (unsigned int i = 0; i != info.path_length; ++i) {
+			expected[info.path[i] + df::coord(0, 0, 1)];
+		}
+	}
+	for (const verify_object& object : objects) {
+		auto iter = expected.find(object.pos);
+		if (iter != expected.end()) {
+			iter->second.push_back(object.loadable);
+		}
+	}
+	
+	// tiles may be left unwatched by the occupancy prefilter, but then must turn out empty, so only extra ones are wrong
+	unsigned int mismatches = 0;
+	for (uint32_t slot = 0; slot != watched_tiles.size(); ++slot) {
+		if (expected.find(watched_tiles.at(slot)) == expected.end()) {
+			PLUGIN_LOG(LEVEL_ERROR, CATEGORY_VERIFY, "verify: tile {} watched, but above no minecart path", watched_tiles.at(slot));
+			++mismatches;
+		}
+	}
+	
+	std::vector<Loadable> actual;
+	for (auto& entry : expected) {
+		loadable_span span = get_loadables_at(entry.first);
+		actual.assign(loadable_arena.begin() + span.first, loadable_arena.begin() + span.first + span.count);
+		std::sort(actual.begin(), actual.end());
+		std::sort(entry.second.begin(), entry.second.end());
+		if (actual != entry.second) {
+			// missing: expected but not recorded; extra: recorded but not expected
+			size_t missing = 0;
+			for (const Loadable& loadable : entry.second) {
+				missing += !std::binary_search(actual.begin(), actual.end(), loadable);
+			}
+			size_t extra = 0;
+			for (const Loadable& loadable : actual) {
+				extra += !std::binary_search(entry.second.begin(), entry.second.end(), loadable);
+			}
+			PLUGIN_LOG(LEVEL_ERROR, CATEGORY_VERIFY, "verify: tile {}: {} loadables missing, {} extra", entry.first, missing, extra);
+			++mismatches;
+		}
+	}
+	return mismatches;
+}
+
+void verify_fill(bool complete) {
+	// checks the fill just made against the reference, counting any mismatches
+	// <complete> is whether the fill considered every object, rather than only those in the air; like the fill, the reference
+	// leaves out what no awake minecart's filter wants
+	verify_objects.clear();
+	for (df::item* item : world->items.all) {
+		if ((complete || is_falling(item)) && Loadable(item).is_wanted()) {
+			push_back_counted(verify_objects, verify_object{Items::getPosition(item), Loadable(item)});
+		}
+	}
+	for (df::unit* unit : world->units.active) {
+		if ((complete || unit->flags1.bits.projectile) && wanted.units) {
+			push_back_counted(verify_objects, verify_object{unit->pos, Loadable(unit)});
+		}
+	}
+	
+	unsigned int mismatches = verify_watched_tiles(minecarts, verify_objects);
+	count(COUNTER_VERIFY_MISMATCHES, mismatches);
+	if (mismatches != 0) {
+		PLUGIN_LOG(LEVEL_ERROR, CATEGORY_VERIFY, "verify: {} mismatching tiles at frame {}", mismatches, world->frame_counter);
+	}
+}
+
+command_result verify_command(color_ostream& out, std::vector<std::string>& parameters) {
+	// console subcommand "verify": query or configure the verification mode
+	if (parameters.size() == 1) {
+		out.print("verify: %s\n", verify_enabled ? "on" : "off");
+		out.print("  mismatching tiles: %llu\n", (unsigned long long)stats.counters[COUNTER_VERIFY_MISMATCHES]);
+		return CR_OK;
+	}
+	
+	if (parameters.size() == 2 && (parameters[1] == "on" || parameters[1] == "off")) {
+		verify_enabled = parameters[1] == "on";
+		return CR_OK;
+	}
+	
+	return CR_WRONG_USAGE;
+}
+
+
+
+// Tracing
+// So that what the plugin saw in a real fort can be reproduced, the inputs of every update can be captured to a trace file and
+// replayed later from the console, apart from the running game: the tracked minecarts with their position, motion, capacity and
+// sleep state, where each loadable recorded above a path is at the start of the update, and what was found on the watched tiles
+// and staged in the columns above them.
+// The replay runs the same path, watch and lookup functions as a real update and repeats its loading decisions, checking them
+// against the decisions recorded live, and is timed, so that a real workload serves as a repeatable benchmark and regression check.
+// A trace is a header followed by one frame per update, each a fixed-size header and arrays of fixed-size records, all 4-byte
+// aligned, so that a trace is walked in place whether read into memory or mapped. Records are in the byte order of the host.
+
+// TRACE_MAGIC, TRACE_VERSION: the first two fields of every trace; the magic reads "MFLT" on little-endian hosts
+const uint32_t TRACE_MAGIC = 0x544c464d;
+const uint32_t TRACE_VERSION = 2;
+
+struct trace_header {
+	uint32_t magic;
+	uint32_t version;
+	// update_interval, lookahead_ticks: the settings the paths were predicted with
+	uint32_t update_interval;
+	uint32_t lookahead_ticks;
+	// packing_mode: the setting the landed items were chosen among with
+	uint32_t packing_mode;
+};
+
+struct trace_frame_header {
+	// update: number of the update within the trace, from 0
+	uint32_t update;
+	// tick: world->frame_counter of the update
+	int32_t tick;
+	uint32_t vehicle_count;
+	uint32_t observation_count;
+	uint32_t content_count;
+	uint32_t incoming_count;
+	uint32_t decision_count;
+	uint32_t filtered_count;
+	uint32_t ranked_count;
+};
+
+enum trace_vehicle_flag : uint32_t {
+	// TRACE_ASLEEP_BEFORE, TRACE_ASLEEP_AFTER: the minecart was asleep at the start, and at the end, of the update
+	TRACE_ASLEEP_BEFORE = 1,
+	TRACE_ASLEEP_AFTER = 2,
+	// TRACE_HAS_RIDER: a unit was riding the minecart at the start of the update
+	TRACE_HAS_RIDER = 4,
+	// TRACE_ITEM_GONE: the minecart item no longer existed, so the minecart was skipped
+	TRACE_ITEM_GONE = 8
+};
+
+struct trace_vehicle {
+	// a tracked minecart at the start of an update; a frame has one for each tracked minecart, in the same order
+	int32_t id;
+	uint32_t flags;
+	int16_t x, y, z;
+	int16_t padding;
+	int32_t offset_x, offset_y, offset_z;
+	int32_t speed_x, speed_y, speed_z;
+	int32_t load_capacity;
+	int32_t loaded_volume;
+};
+
+struct trace_loadable {
+	// a loadable: as an observation, where it is at the start of an update; as content, the watched tile it was found on;
+	// as incoming, the path tile it was staged to land on
+	int32_t id;
+	// volume: for observations and incoming of items, the item's volume; otherwise 0
+	int32_t volume;
+	// tick: for incoming, world->frame_counter on which it was estimated to land; otherwise 0
+	int32_t tick;
+	int16_t x, y, z;
+	uint8_t kind;
+	uint8_t padding;
+};
+
+struct trace_decision {
+	// a loadable that perform_minecart_loading loaded, or queued to be loaded, into a minecart; as filtered, one that it
+	// passed over because of the minecart's loading filter; or, as ranked, an item that landed on the minecart and which its
+	// priority order did not rank best
+	int32_t minecart_id;
+	int32_t id;
+	uint8_t kind;
+	// rank: as ranked, the rank the item was given; otherwise 0
+	uint8_t rank;
+	uint8_t padding[2];
+};
+
+static_assert(
+	sizeof(trace_header) % 4 == 0 && sizeof(trace_frame_header) % 4 == 0 && sizeof(trace_vehicle) % 4 == 0
+		&& sizeof(trace_loadable) % 4 == 0 && sizeof(trace_decision) % 4 == 0,
+	"trace records must keep the records after them 4-byte aligned"
+);
+
+// trace_file: the trace being captured; only open while capturing
+std::ofstream trace_file;
+// trace_update: number of the next update to be captured
+uint32_t trace_update = 0;
+// trace_vehicles, trace_observations, trace_contents, trace_incoming, trace_decisions, trace_filtered_loadables,
+// trace_ranked_landings: the frame being captured, written out by trace_end_frame
+std::vector<trace_vehicle> trace_vehicles;
+std::vector<trace_loadable> trace_observations;
+std::vector<trace_loadable> trace_contents;
+std::vector<trace_loadable> trace_incoming;
+std::vector<trace_decision> trace_decisions;
+std::vector<trace_decision> trace_filtered_loadables;
+std::vector<trace_decision> trace_ranked_landings;
+
+bool is_tracing() {
+	// returns whether updates are being captured
+	return trace_file.is_open();
+}
+
+trace_loadable make_trace_loadable(const Loadable& loadable, df::coord pos, int32_t volume) {
+	// returns the trace record of <loadable> at coord <pos>, of volume <volume>
+	trace_loadable out = trace_loadable();
+	out.id = loadable.id();
+	out.volume = volume;
+	out.x = pos.x;
+	out.y = pos.y;
+	out.z = pos.z;
+	out.kind = uint8_t(loadable.kind());
+	return out;
+}
+
+bool start_trace(const std::string& path) {
+	// begins capturing updates to a new trace at <path>, replacing any file there; returns whether it could be created
+	trace_file.close();
+	trace_file.open(path, std::ios::binary | std::ios::trunc);
+	if (!trace_file) {
+		trace_file.close();
+		return false;
+	}
+	trace_header header = trace_header();
+	header.magic = TRACE_MAGIC;
+	header.version = TRACE_VERSION;
+	header.update_interval = update_interval;
+	header.lookahead_ticks = lookahead_ticks;
+	header.packing_mode = packing_mode;
+	trace_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	trace_update = 0;
+	PLUGIN_LOG(LEVEL_INFO, CATEGORY_GENERAL, "start_trace: capturing");
+	return true;
+}
+
+void stop_trace() {
+	// stops capturing, if capturing
+	if (is_tracing()) {
+		PLUGIN_LOG(LEVEL_INFO, CATEGORY_GENERAL, "stop_trace: {} updates captured", trace_update);
+		trace_file.close();
+	}
+}
+
+void trace_begin_frame() {
+	// records the inputs of the update about to be performed: the tracked minecarts, and where the loadables last recorded
+	// above their paths or staged in their columns are now; called between update_minecart_list and perform_minecart_loading
+	trace_vehicles.clear();
+	trace_observations.clear();
+	trace_contents.clear();
+	trace_incoming.clear();
+	trace_decisions.clear();
+	trace_filtered_loadables.clear();
+	trace_ranked_landings.clear();
+	
+	for (minecart_info& info : minecarts) {
+		trace_vehicle vehicle = trace_vehicle();
+		vehicle.id = info.id;
+		vehicle.flags = info.asleep ? uint32_t(TRACE_ASLEEP_BEFORE) : uint32_t(0);
+		const df::vehicle* minecart = info.minecart;
+		vehicle.offset_x = minecart->offset_x;
+		vehicle.offset_y = minecart->offset_y;
+		vehicle.offset_z = minecart->offset_z;
+		vehicle.speed_x = minecart->speed_x;
+		vehicle.speed_y = minecart->speed_y;
+		vehicle.speed_z = minecart->speed_z;
+		
+		df::item* minecart_item = info.minecart_item.get();
+		if (minecart_item == nullptr) {
+			vehicle.flags |= TRACE_ITEM_GONE;
+		} else {
+			// as perform_minecart_loading will, so that the volume recorded is the one it decides with
+			revalidate_loaded_volume(info);
+			df::coord pos = Items::getPosition(minecart_item);
+			vehicle.x = pos.x;
+			vehicle.y = pos.y;
+			vehicle.z = pos.z;
+			vehicle.load_capacity = info.load_capacity;
+			vehicle.loaded_volume = info.loaded_volume;
+			if (minecart_item->flags2.bits.has_rider) {
+				vehicle.flags |= TRACE_HAS_RIDER;
+			}
+		}
+		push_back_counted(trace_vehicles, vehicle);
+	}
+	
+	for (const Loadable& loadable : loadable_arena) {
+		df::item* item = loadable.kind() == Loadable::ITEM ? loadable.item() : nullptr;
+		push_back_counted(trace_observations, make_trace_loadable(loadable, loadable.pos(), item != nullptr ? item->getVolume() : 0));
+	}
+	for (const incoming_load& incoming : incoming_arena) {
+		push_back_counted(trace_observations, make_trace_loadable(incoming.loadable, incoming.loadable.pos(), incoming.volume));
+	}
+}
+
+trace_decision make_trace_decision(const minecart_info& info, const Loadable& loadable) {
+	// returns the trace record of a decision about <loadable> and the minecart of <info>
+	trace_decision decision = trace_decision();
+	decision.minecart_id = info.id;
+	decision.id = loadable.id();
+	decision.kind = uint8_t(loadable.kind());
+	return decision;
+}
+
+void trace_load_decision(const minecart_info& info, const Loadable& loadable) {
+	// records that perform_minecart_loading loaded, or queued to be loaded, <loadable> into the minecart of <info>
+	push_back_counted(trace_decisions, make_trace_decision(info, loadable));
+}
+
+void trace_filtered(const minecart_info& info, const Loadable& loadable) {
+	// records that perform_minecart_loading passed over <loadable> because of the loading filter of the minecart of <info>
+	push_back_counted(trace_filtered_loadables, make_trace_decision(info, loadable));
+}
+
+void trace_ranked(const minecart_info& info, const Loadable& loadable, uint8_t rank) {
+	// records that item <loadable> landed on the minecart of <info>, and that its priority order gave it rank <rank>
+	trace_decision decision = make_trace_decision(info, loadable);
+	decision.rank = rank;
+	push_back_counted(trace_ranked_landings, decision);
+}
+
+template <typename T>
+void write_trace_records(const std::vector<T>& records) {
+	// appends <records> to trace_file
+	trace_file.write(reinterpret_cast<const char*>(records.data()), std::streamsize(records.size() * sizeof(T)));
+}
+
+void trace_end_frame() {
+	// records the rest of the update just performed, what was found on the watched tiles and staged in the columns, and which
+	// minecarts are asleep, and writes its frame to trace_file; called after update_minecart_info
+	for (size_t i = 0; i != minecarts.size(); ++i) {
+		if (minecarts[i].asleep) {
+			trace_vehicles[i].flags |= TRACE_ASLEEP_AFTER;
+		}
+	}
+	for (uint32_t slot = 0; slot != tile_spans.size(); ++slot) {
+		df::coord tile = watched_tiles.at(slot);
+		loadable_span span = tile_spans[slot];
+		for (uint32_t i = 0; i != span.count; ++i) {
+			push_back_counted(trace_contents, make_trace_loadable(loadable_arena[span.first + i], tile, 0));
+		}
+	}
+	for (uint32_t slot = 0; slot != column_spans.size(); ++slot) {
+		df::coord base = column_bases.at(slot);
+		loadable_span span = column_spans[slot];
+		for (uint32_t i = 0; i != span.count; ++i) {
+			const incoming_load& incoming = incoming_arena[span.first + i];
+			trace_loadable record = make_trace_loadable(incoming.loadable, base, incoming.volume);
+			record.tick = incoming.arrival_tick;
+			push_back_counted(trace_incoming, record);
+		}
+	}
+	
+	trace_frame_header header = trace_frame_header();
+	header.update = trace_update++;
+	header.tick = world->frame_counter;
+	header.vehicle_count = uint32_t(trace_vehicles.size());
+	header.observation_count = uint32_t(trace_observations.size());
+	header.content_count = uint32_t(trace_contents.size());
+	header.incoming_count = uint32_t(trace_incoming.size());
+	header.decision_count = uint32_t(trace_decisions.size());
+	header.filtered_count = uint32_t(trace_filtered_loadables.size());
+	header.ranked_count = uint32_t(trace_ranked_landings.size());
+	trace_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	write_trace_records(trace_vehicles);
+	write_trace_records(trace_observations);
+	write_trace_records(trace_contents);
+	write_trace_records(trace_incoming);
+	write_trace_records(trace_decisions);
+	write_trace_records(trace_filtered_loadables);
+	write_trace_records(trace_ranked_landings);
+	
+	if (!trace_file) {
+		PLUGIN_LOG(LEVEL_ERROR, CATEGORY_GENERAL, "trace_end_frame: write failed; capture stopped after {} updates", trace_update);
+		trace_file.close();
+	}
+}
+
+struct trace_frame {
+	// a frame of a trace, pointing into the trace itself
+	const trace_frame_header* header;
+	const trace_vehicle* vehicles;
+	const trace_loadable* observations;
+	const trace_loadable* contents;
+	const trace_loadable* incoming;
+	const trace_decision* decisions;
+	const trace_decision* filtered;
+	const trace_decision* ranked;
+};
+
+template <typename T>
+const T* take_trace_records(const char* data, size_t size, size_t& offset, uint32_t count) {
+	// returns the <count> records of type T at <offset> into the <size> bytes of <data>, and moves <offset> past them;
+	// nullptr if they would run past the end
+	if ((size - offset) / sizeof(T) < count) {
+		return nullptr;
+	}
+	const T* out = reinterpret_cast<const T*>(data + offset);
+	offset += count * sizeof(T);
+	return out;
+}
+
+bool index_trace(const char* data, size_t size, const trace_header*& header, std::vector<trace_frame>& frames) {
+	// finds the header and frames of the trace in the <size> bytes of <data>, which must be 4-byte aligned, without copying them;
+	// returns whether it is a whole trace of this version
+	frames.clear();
+	size_t offset = 0;
+	header = take_trace_records<trace_header>(data, size, offset, 1);
+	if (header == nullptr || header->magic != TRACE_MAGIC || header->version != TRACE_VERSION
+		|| header->packing_mode >= PACKING_MODE_COUNT) {
+		return false;
+	}
+	while (offset != size) {
+		trace_frame frame;
+		frame.header = take_trace_records<trace_frame_header>(data, size, offset, 1);
+		if (frame.header == nullptr) {
+			return false;
+		}
+		frame.vehicles = take_trace_records<trace_vehicle>(data, size, offset, frame.header->vehicle_count);
+		frame.observations = take_trace_records<trace_loadable>(data, size, offset, frame.header->observation_count);
+		frame.contents = take_trace_records<trace_loadable>(data, size, offset, frame.header->content_count);
+		frame.incoming = take_trace_records<trace_loadable>(data, size, offset, frame.header->incoming_count);
+		frame.decisions = take_trace_records<trace_decision>(data, size, offset, frame.header->decision_count);
+		frame.filtered = take_trace_records<trace_decision>(data, size, offset, frame.header->filtered_count);
+		frame.ranked = take_trace_records<trace_decision>(data, size, offset, frame.header->ranked_count);
+		if (frame.vehicles == nullptr || frame.observations == nullptr || frame.contents == nullptr || frame.incoming == nullptr
+			|| frame.decisions == nullptr || frame.filtered == nullptr || frame.ranked == nullptr) {
+			return false;
+		}
+		frames.push_back(frame);
+	}
+	return true;
+}
+
+class live_state_stash {
+	// sets aside the plugin's per-world state and stats for its lifetime, so that a replay can run the real functions apart from the fort
+	public:
+		live_state_stash();
+		~live_state_stash();
+	private:
+		coord_table live_watched_tiles;
+		std::vector<loadable_span> live_tile_spans;
+		std::vector<Loadable> live_loadable_arena;
+		std::vector<tile_match> live_tile_matches;
+		coord_table live_column_bases;
+		std::vector<loadable_span> live_column_spans;
+		std::vector<incoming_load> live_incoming_arena;
+		std::vector<column_match> live_column_matches;
+		std::vector<minecart_info> live_minecarts;
+		vector_epoch live_item_epoch;
+		vector_epoch live_unit_epoch;
+		std::unordered_map<int32_t, df::proj_list_link*> live_projectile_index;
+		bool live_projectile_index_valid;
+		std::vector<pending_item_load> live_pending_item_loads;
+		position_snapshot live_item_snapshot;
+		std::unordered_map<uint64_t, block_record> live_block_records;
+		std::vector<Loadable> live_event_candidates;
+		coord_table live_event_watched_tiles;
+		unsigned int live_sweep_counter;
+		std::vector<cart_plan> live_cart_plans;
+		bool live_plan_posted;
+		std::map<int32_t, load_filter> live_route_filters;
+		std::map<int32_t, load_filter> live_cart_filters;
+		wanted_loadables live_wanted;
+		plugin_stats live_stats;
+		uint64_t live_buffer_growths;
+};
+
+live_state_stash::live_state_stash()
+  : live_item_epoch(item_epoch),
+    live_unit_epoch(unit_epoch),
+    live_projectile_index_valid(projectile_index_valid),
+    live_item_snapshot(position_snapshot()),
+    live_sweep_counter(sweep_counter),
+    live_plan_posted(plan_posted),
+    live_wanted(wanted),
+    live_stats(stats),
+    live_buffer_growths(buffer_growths)
+{
+	// the planner must not be left planning from state that is about to be set aside
+	finish_plan();
+	std::swap(watched_tiles, live_watched_tiles);
+	tile_spans.swap(live_tile_spans);
+	loadable_arena.swap(live_loadable_arena);
+	tile_matches.swap(live_tile_matches);
+	std::swap(column_bases, live_column_bases);
+	column_spans.swap(live_column_spans);
+	incoming_arena.swap(live_incoming_arena);
+	column_matches.swap(live_column_matches);
+	minecarts.swap(live_minecarts);
+	projectile_index.swap(live_projectile_index);
+	pending_item_loads.swap(live_pending_item_loads);
+	std::swap(item_snapshot, live_item_snapshot);
+	block_records.swap(live_block_records);
+	event_candidates.swap(live_event_candidates);
+	std::swap(event_watched_tiles, live_event_watched_tiles);
+	cart_plans.swap(live_cart_plans);
+	route_filters.swap(live_route_filters);
+	cart_filters.swap(live_cart_filters);
+	item_epoch = vector_epoch{0, -1, 1};
+	unit_epoch = vector_epoch{0, -1, 1};
+	projectile_index_valid = false;
+	item_snapshot.stale = true;
+	sweep_counter = 0;
+	plan_posted = false;
+	want_everything();
+	stats = plugin_stats();
+	buffer_growths = 0;
+	++registry_generation;
+	++filters_generation;
+}
+
+live_state_stash::~live_state_stash() {
+	finish_plan();
+	std::swap(watched_tiles, live_watched_tiles);
+	tile_spans.swap(live_tile_spans);
+	loadable_arena.swap(live_loadable_arena);
+	tile_matches.swap(live_tile_matches);
+	std::swap(column_bases, live_column_bases);
+	column_spans.swap(live_column_spans);
+	incoming_arena.swap(live_incoming_arena);
+	column_matches.swap(live_column_matches);
+	minecarts.swap(live_minecarts);
+	projectile_index.swap(live_projectile_index);
+	pending_item_loads.swap(live_pending_item_loads);
+	std::swap(item_snapshot, live_item_snapshot);
+	block_records.swap(live_block_records);
+	event_candidates.swap(live_event_candidates);
+	std::swap(event_watched_tiles, live_event_watched_tiles);
+	cart_plans.swap(live_cart_plans);
+	route_filters.swap(live_route_filters);
+	cart_filters.swap(live_cart_filters);
+	item_epoch = live_item_epoch;
+	unit_epoch = live_unit_epoch;
+	projectile_index_valid = live_projectile_index_valid;
+	sweep_counter = live_sweep_counter;
+	plan_posted = live_plan_posted;
+	wanted = live_wanted;
+	stats = live_stats;
+	buffer_growths = live_buffer_growths;
+	// pointers into minecarts, and the filters resolved from the set-aside filters, may be stale
+	++registry_generation;
+	++filters_generation;
+}
+
+struct replay_state {
+	// what a replay keeps from one frame to the next, in place of the live plugin's state
+	// vehicles: the minecarts' vehicles for the current frame, referred to by carts[i].minecart
+	std::vector<df::vehicle> vehicles;
+	std::vector<minecart_info> carts;
+	std::vector<minecart_info> carts_scratch;
+	// observations: the current frame's observations, sorted by kind and id
+	std::vector<trace_loadable> observations;
+	// filtered: the current frame's loadables passed over by loading filters, sorted
+	std::vector<trace_decision> filtered;
+	// ranked: the current frame's landings ranked below the best by priority orders, sorted
+	std::vector<trace_decision> ranked;
+	// packing_mode: the trace's packing_mode
+	packing_mode_t packing_mode;
+	// landings: the items that landed on the minecart being replayed, as landing_batch
+	std::vector<landing> landings;
+	// queued_items: ids of the items queued for loading in the current frame
+	std::vector<int32_t> queued_items;
+	// decisions: the loading decisions replayed for the current frame
+	std::vector<trace_decision> decisions;
+};
+
+bool trace_loadable_less(const trace_loadable& a, const trace_loadable& b) {
+	// orders trace records of loadables by kind, then id
+	return a.kind != b.kind ? a.kind < b.kind : a.id < b.id;
+}
+
+void replay_minecart_list(const trace_frame& frame, replay_state& state) {
+	// as update_minecart_list, brings the tracked minecarts of <state> up to date with those recorded in <frame>,
+	// along with the state of each that the replay does not recompute
+	state.vehicles.assign(frame.header->vehicle_count, df::vehicle());
+	state.carts_scratch.clear();
+	auto tracked = state.carts.begin();
+	for (uint32_t i = 0; i != frame.header->vehicle_count; ++i) {
+		const trace_vehicle& recorded = frame.vehicles[i];
+		df::vehicle& vehicle = state.vehicles[i];
+		vehicle.id = recorded.id;
+		vehicle.offset_x = recorded.offset_x;
+		vehicle.offset_y = recorded.offset_y;
+		vehicle.offset_z = recorded.offset_z;
+		vehicle.speed_x = recorded.speed_x;
+		vehicle.speed_y = recorded.speed_y;
+		vehicle.speed_z = recorded.speed_z;
+		
+		while (tracked != state.carts.end() && tracked->id < recorded.id) {
+			++tracked;
+		}
+		if (tracked != state.carts.end() && tracked->id == recorded.id) {
+			state.carts_scratch.push_back(*tracked);
+			++tracked;
+		} else {
+			minecart_info info = minecart_info();
+			info.id = recorded.id;
+			state.carts_scratch.push_back(info);
+		}
+		
+		minecart_info& info = state.carts_scratch.back();
+		info.minecart = &vehicle;
+		// whether a minecart sleeps depends on the map, so is taken from the trace rather than decided again
+		info.asleep = (recorded.flags & TRACE_ASLEEP_BEFORE) != 0;
+		info.load_capacity = recorded.load_capacity;
+		info.loaded_volume = recorded.loaded_volume;
+	}
+	state.carts.swap(state.carts_scratch);
+}
+
+bool trace_decision_less(const trace_decision& a, const trace_decision& b) {
+	// orders trace records of decisions by minecart, then kind, then id
+	if (a.minecart_id != b.minecart_id) {
+		return a.minecart_id < b.minecart_id;
+	}
+	return a.kind != b.kind ? a.kind < b.kind : a.id < b.id;
+}
+
+bool was_filtered(const replay_state& state, const minecart_info& info, const Loadable& loadable) {
+	// returns whether <loadable> was passed over by the loading filter of the minecart of <info> in the frame being replayed
+	// filters depend on the items themselves, so their verdicts are taken from the trace rather than reached again
+	return std::binary_search(state.filtered.begin(), state.filtered.end(), make_trace_decision(info, loadable), trace_decision_less);
+}
+
+uint8_t get_traced_rank(const replay_state& state, const minecart_info& info, const Loadable& loadable) {
+	// returns the rank the priority order of the minecart of <info> gave item <loadable> in the frame being replayed
+	// taken from the trace, as the filters and item types are not in it; 0 if none was recorded
+	trace_decision key = make_trace_decision(info, loadable);
+	auto ranked = std::lower_bound(state.ranked.begin(), state.ranked.end(), key, trace_decision_less);
+	return ranked != state.ranked.end() && !trace_decision_less(key, *ranked) ? ranked->rank : 0;
+}
+
+bool has_landed(const replay_state& state, const Loadable& loadable, df::coord tile, int32_t& volume) {
+	// returns whether <loadable> was observed on coord <tile> at the start of the frame being replayed, setting <volume> to
+	// its observed volume if so
+	trace_loadable key = make_trace_loadable(loadable, df::coord(), 0);
+	auto seen = std::lower_bound(state.observations.begin(), state.observations.end(), key, trace_loadable_less);
+	if (seen == state.observations.end() || trace_loadable_less(key, *seen) || df::coord(seen->x, seen->y, seen->z) != tile) {
+		return false;
+	}
+	volume = seen->volume;
+	return true;
+}
+
+void replay_on_landed(minecart_info& info, const Loadable& loadable, int32_t volume, bool& has_rider, replay_state& state) {
+	// as on_landed, with the fit check for a unit made from <has_rider>, adds <loadable>, if an item, to state.landings, or
+	// decides whether to load it into the minecart of <info>, and if so records it in state.decisions
+	if (loadable.kind() == Loadable::ITEM) {
+		add_landing(state.landings, loadable, volume, get_traced_rank(state, info, loadable));
+		return;
+	}
+	// as can_unit_fit, then load_minecart_with_unit
+	if (has_rider) {
+		return;
+	}
+	has_rider = true;
+	state.decisions.push_back(make_trace_decision(info, loadable));
+}
+
+void replay_resolve_landings(minecart_info& info, replay_state& state) {
+	// as resolve_landings, chooses which of state.landings to load into the minecart of <info>, and records them in
+	// state.decisions; empties state.landings
+	state.landings.erase(
+		std::remove_if(
+			state.landings.begin(),
+			state.landings.end(),
+			[&state](const landing& landed) {
+				return std::find(state.queued_items.begin(), state.queued_items.end(), landed.loadable.id()) != state.queued_items.end();
+			}
+		),
+		state.landings.end()
+	);
+	unsigned int chosen = choose_landings(state.landings, info.load_capacity - info.loaded_volume, state.packing_mode);
+	for (unsigned int i = 0; i != chosen; ++i) {
+		const landing& landed = state.landings[i];
+		state.queued_items.push_back(landed.loadable.id());
+		info.loaded_volume += landed.volume;
+		state.decisions.push_back(make_trace_decision(info, landed.loadable));
+	}
+	state.landings.clear();
+}
+
+void replay_minecart_loading(const trace_frame& frame, unsigned int horizon_ticks, replay_state& state) {
+	// as perform_minecart_loading, decides which of the loadables last recorded above each minecart's path or staged in its
+	// columns, along paths predicted for <horizon_ticks> ticks, to load into it, taking where the loadables are and their volumes
+	// from <frame>; the decisions are left in state.decisions
+	state.observations.assign(frame.observations, frame.observations + frame.header->observation_count);
+	std::sort(state.observations.begin(), state.observations.end(), trace_loadable_less);
+	state.filtered.assign(frame.filtered, frame.filtered + frame.header->filtered_count);
+	std::sort(state.filtered.begin(), state.filtered.end(), trace_decision_less);
+	state.ranked.assign(frame.ranked, frame.ranked + frame.header->ranked_count);
+	std::sort(state.ranked.begin(), state.ranked.end(), trace_decision_less);
+	state.queued_items.clear();
+	state.decisions.clear();
+	
+	for (uint32_t i = 0; i != frame.header->vehicle_count; ++i) {
+		minecart_info& info = state.carts[i];
+		const trace_vehicle& recorded = frame.vehicles[i];
+		if (info.asleep || (recorded.flags & TRACE_ITEM_GONE) != 0) {
+			continue;
+		}
+		bool has_rider = (recorded.flags & TRACE_HAS_RIDER) != 0;
+		unsigned int crossed = count_crossed_tiles(info, df::coord(recorded.x, recorded.y, recorded.z));
+		
+		for (unsigned int tile = 0; tile != crossed; ++tile) {
+			loadable_span above_set = info.above_path[tile];
+			for (uint32_t j = 0; j != above_set.count; ++j) {
+				const Loadable& loadable = loadable_arena[above_set.first + j];
+				int32_t volume;
+				if (has_landed(state, loadable, info.path[tile], volume) && !was_filtered(state, info, loadable)
+					&& was_on_tile(info, tile, crossed, 1, horizon_ticks)) {
+					replay_on_landed(info, loadable, volume, has_rider, state);
+				}
+			}
+			
+			loadable_span incoming_set = info.incoming_path[tile];
+			for (uint32_t j = 0; j != incoming_set.count; ++j) {
+				const incoming_load& incoming = incoming_arena[incoming_set.first + j];
+				int32_t volume;
+				if (has_landed(state, incoming.loadable, info.path[tile], volume) && !was_filtered(state, info, incoming.loadable)
+					&& was_on_tile(info, tile, crossed, get_landing_tick(info, incoming.arrival_tick, frame.header->tick), horizon_ticks)) {
+					// with the volume resolved when staged
+					replay_on_landed(info, incoming.loadable, incoming.volume, has_rider, state);
+				}
+			}
+		}
+		
+		replay_resolve_landings(info, state);
+	}
+}
+
+void replay_minecart_info(const trace_frame& frame, unsigned int horizon_ticks, replay_state& state) {
+	// as update_minecart_info, advances each minecart's path and watches the tiles above it and follows their columns, then
+	// fills the watched tiles and columns with the contents recorded in <frame> and hands each minecart its share
+	// tiles are watched without the occupancy prefilter, which needs the map; a tile it left unwatched has no recorded contents,
+	// and likewise every column is followed, whatever column_height was
+	clear_watched_tiles();
+	clear_columns();
+	for (uint32_t i = 0; i != frame.header->vehicle_count; ++i) {
+		minecart_info& info = state.carts[i];
+		const trace_vehicle& recorded = frame.vehicles[i];
+		if ((recorded.flags & TRACE_ITEM_GONE) != 0) {
+			continue;
+		}
+		if (info.asleep) {
+			if ((recorded.flags & TRACE_ASLEEP_AFTER) != 0) {
+				continue;
+			}
+			info.asleep = false;
+			info.idle_updates = 0;
+		}
+		
+		df::coord current_pos(recorded.x, recorded.y, recorded.z);
+		info.pos = current_pos;
+		info.path_tick = frame.header->tick;
+		advance_path(info, current_pos, horizon_ticks);
+		for (unsigned int j = 0; j != info.path_length; ++j) {
+			column_bases.insert(info.path[j]);
+			watch_tile(info.path[j] + df::coord(0, 0, 1));
+		}
+	}
+	
+	for (uint32_t i = 0; i != frame.header->content_count; ++i) {
+		const trace_loadable& content = frame.contents[i];
+		record_match(df::coord(content.x, content.y, content.z), Loadable(Loadable::kind_t(content.kind), content.id));
+	}
+	// the contents were traced after what no minecart wanted had been dropped, and the objects may be gone by now
+	want_everything();
+	group_tile_matches();
+	for (uint32_t i = 0; i != frame.header->incoming_count; ++i) {
+		const trace_loadable& recorded = frame.incoming[i];
+		incoming_load incoming = incoming_load();
+		incoming.loadable = Loadable(Loadable::kind_t(recorded.kind), recorded.id);
+		incoming.arrival_tick = recorded.tick;
+		incoming.volume = recorded.volume;
+		stage_incoming(df::coord(recorded.x, recorded.y, recorded.z), incoming);
+	}
+	group_column_matches();
+	
+	for (uint32_t i = 0; i != frame.header->vehicle_count; ++i) {
+		minecart_info& info = state.carts[i];
+		if (info.asleep) {
+			continue;
+		}
+		for (unsigned int j = 0; j != info.path_length; ++j) {
+			info.above_path[j] = get_loadables_at(info.path[j] + df::coord(0, 0, 1));
+			info.incoming_path[j] = get_incoming_at(info.path[j]);
+		}
+		info.asleep = (frame.vehicles[i].flags & TRACE_ASLEEP_AFTER) != 0;
+	}
+}
+
+bool same_decisions(const trace_decision* recorded, uint32_t recorded_count, const std::vector<trace_decision>& replayed) {
+	// returns whether the <recorded_count> decisions of <recorded> are the same, in the same order, as <replayed>
+	if (recorded_count != replayed.size()) {
+		return false;
+	}
+	for (uint32_t i = 0; i != recorded_count; ++i) {
+		if (recorded[i].minecart_id != replayed[i].minecart_id || recorded[i].id != replayed[i].id || recorded[i].kind != replayed[i].kind) {
+			return false;
+		}
+	}
+	return true;
+}
+
+struct replay_result {
+	uint64_t total_ns;
+	uint64_t decisions;
+	// mismatched_frames: frames whose replayed decisions differ from those recorded, over all rounds
+	uint32_t mismatched_frames;
+	// first_mismatch: update of the first mismatched frame
+	uint32_t first_mismatch;
+};
+
+replay_result replay_trace(const trace_header& header, const std::vector<trace_frame>& frames, unsigned int rounds) {
+	// replays <frames> <rounds> times from the start, and returns the time taken and how the decisions compared
+	// the decisions of a trace's first update were made from what was watched before capturing began, so are not compared
+	replay_result result = replay_result();
+	unsigned int horizon_ticks = std::max(header.lookahead_ticks, header.update_interval);
+	for (unsigned int round = 0; round != rounds; ++round) {
+		replay_state state;
+		state.packing_mode = packing_mode_t(header.packing_mode);
+		clear_watched_tiles();
+		auto start = std::chrono::steady_clock::now();
+		for (const trace_frame& frame : frames) {
+			replay_minecart_list(frame, state);
+			replay_minecart_loading(frame, horizon_ticks, state);
+			replay_minecart_info(frame, horizon_ticks, state);
+			
+			result.decisions += state.decisions.size();
+			if (frame.header->update != 0 && !same_decisions(frame.decisions, frame.header->decision_count, state.decisions)) {
+				PLUGIN_LOG(LEVEL_ERROR, CATEGORY_VERIFY, "replay_trace: update {}: {} decisions replayed, {} recorded",
+					frame.header->update, state.decisions.size(), frame.header->decision_count);
+				if (result.mismatched_frames == 0) {
+					result.first_mismatch = frame.header->update;
+				}
+				++result.mismatched_frames;
+			}
+		}
+		result.total_ns += uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+	}
+	return result;
+}
+
+command_result trace_command(color_ostream& out, std::vector<std::string>& parameters) {
+	// console subcommand "trace": capture updates to a trace, or replay one
+	if (parameters.size() == 1) {
+		out.print("trace: %s\n", is_tracing() ? "capturing" : "off");
+		if (is_tracing()) {
+			out.print("  updates captured: %u\n", trace_update);
+		}
+		return CR_OK;
+	}
+	
+	if (parameters.size() == 3 && parameters[1] == "start") {
+		if (!start_trace(parameters[2])) {
+			out.printerr("trace: could not create %s\n", parameters[2].c_str());
+			return CR_FAILURE;
+		}
+		return CR_OK;
+	}
+	
+	if (parameters.size() == 2 && parameters[1] == "stop") {
+		stop_trace();
+		return CR_OK;
+	}
+	
+	if (parameters.size() >= 3 && parameters[1] == "replay") {
+		unsigned int rounds = 1;
+		if (parameters.size() == 5 && parameters[3] == "rounds") {
+			if (!parse_uint(parameters[4], rounds) || rounds == 0) {
+				return CR_WRONG_USAGE;
+			}
+		} else if (parameters.size() != 3) {
+			return CR_WRONG_USAGE;
+		}
+		
+		std::ifstream file(parameters[2], std::ios::binary | std::ios::ate);
+		std::vector<char> data(file ? size_t(file.tellg()) : 0);
+		file.seekg(0);
+		file.read(data.data(), std::streamsize(data.size()));
+		const trace_header* header;
+		std::vector<trace_frame> frames;
+		if (!file || !index_trace(data.data(), data.size(), header, frames)) {
+			out.printerr("trace: %s is not a whole trace\n", parameters[2].c_str());
+			return CR_FAILURE;
+		}
+		
+		// the replay overwrites the live watched tiles and stats
+		live_state_stash stash;
+		replay_result result = replay_trace(*header, frames, rounds);
+		uint64_t updates = uint64_t(frames.size()) * rounds;
+		out.print("trace replay: %zu updates, %u rounds, %llu decisions, %u mismatched updates",
+			frames.size(), rounds, (unsigned long long)result.decisions, result.mismatched_frames
+		);
+		if (result.mismatched_frames != 0) {
+			out.print(" (first %u; see the log)", result.first_mismatch);
+		}
+		out.print("\n  %10.2f us/update\n", updates ? double(result.total_ns) / updates / 1000 : 0.0);
+		return result.mismatched_frames == 0 ? CR_OK : CR_FAILURE;
+	}
+	
+	return CR_WRONG_USAGE;
+}
+
+
+
+// Main three update functions:
+// * update_minecart_list
+// * perform_minecart_loading
+// * update_minecart_info
+
+void update_minecart_list() {
+	// updates the list of currently tracked minecarts:
+	// * removes no longer existing minecarts
+	// * begins tracking new, previously untracked minecarts
+	// both lists are sorted by id, so this is a single merge pass with no lookups
+	
+	if (minecarts_scratch.capacity() < world->vehicles.all.size()) {
+		++buffer_growths;
+	}
+	minecarts_scratch.clear();
+	minecarts_scratch.reserve(world->vehicles.all.size());
+	
+	unsigned int num_removed = 0;
+	unsigned int num_inserted = 0;
+	
+	auto tracked = minecarts.begin();
+	for (df::vehicle* v : world->vehicles.all) {
+		// records whose ids come before v's no longer have a vehicle
+		while (tracked != minecarts.end() && tracked->id < v->id) {
+			++tracked;
+			++num_removed;
+		}
+		
+		// a record is only kept while its vehicle is still of the same minecart item; otherwise it is begun afresh
+		if (tracked != minecarts.end() && tracked->id == v->id && tracked->minecart_item.get_id() == v->item_id) {
+			minecarts_scratch.push_back(*tracked);
+			minecarts_scratch.back().minecart = v;
+			++tracked;
+		} else {
+			if (tracked != minecarts.end() && tracked->id == v->id) {
+				++tracked;
+				++num_removed;
+			}
+			minecarts_scratch.push_back(make_minecart_info(v));
+			++num_inserted;
+		}
+	}
+	num_removed += (unsigned int)(minecarts.end() - tracked);
+	
+	minecarts.swap(minecarts_scratch);
+	
+	if (num_removed != 0 || num_inserted != 0) {
+		++registry_generation;
+	}
+	
+	PLUGIN_LOG(LEVEL_DEBUG, CATEGORY_REGISTRY, "update_minecart_list: {} removed, {} inserted, {} tracked", num_removed, num_inserted, minecarts.size());
+}
+
+bool passes_filter(const minecart_info& info, const Loadable& loadable) {
+	// returns whether the loading filter of the minecart of <info> lets <loadable> be loaded into it, counting it if not
+	if (loadable.passes_filter(info)) {
+		return true;
+	}
+	count(COUNTER_FILTERED);
+	if (is_tracing()) {
+		trace_filtered(info, loadable);
+	}
+	return false;
+}
+
+uint8_t get_landing_rank(const minecart_info& info, const Loadable& loadable) {
+	// returns the rank of item <loadable> in the priority order of the loading filter of the minecart of <info>; 0 if it has none
+	if (info.filter == nullptr || !info.filter->prioritized) {
+		return 0;
+	}
+	df::item* item = loadable.item();
+	int32_t type = item != nullptr ? item->getType() : -1;
+	return type >= 0 && size_t(type) < ITEM_TYPE_LIMIT ? info.filter->ranks[size_t(type)] : UINT8_MAX;
+}
+
+void on_landed(minecart_info& info, const Loadable& loadable, int32_t volume) {
+	// deals with <loadable>, of volume <volume> if an item, which has landed on the minecart of <info>: an item is added to
+	// landing_batch, to be chosen among by resolve_landings; a unit is loaded at once if there is room, and the outcome counted
+	if (loadable.kind() == Loadable::ITEM) {
+		add_landing(landing_batch, loadable, volume, get_landing_rank(info, loadable));
+		return;
+	}
+	if (!loadable.can_fit(info)) {
+		count(COUNTER_REJECTED_OCCUPIED);
+		return;
+	}
+	PLUGIN_LOG(LEVEL_DEBUG, CATEGORY_LOADING, "unit can fit; loading");
+	bool loaded = loadable.load(info);
+	if (loaded && is_tracing()) {
+		trace_load_decision(info, loadable);
+	}
+	count(loaded ? COUNTER_UNITS_LOADED : COUNTER_REJECTED_LOAD_FAILED);
+}
+
+void resolve_landings(minecart_info& info) {
+	// chooses which of the items in landing_batch, all of which have landed on the minecart of <info>, to load, by their ranks
+	// and packing_mode, queues them to be loaded, and counts the rest as rejected; empties landing_batch
+	// an item already queued for a minecart whose path shares its tile is left to that minecart
+	landing_batch.erase(
+		std::remove_if(
+			landing_batch.begin(),
+			landing_batch.end(),
+			[](const landing& landed) { return find_pending_load(landed.loadable.item()) != nullptr; }
+		),
+		landing_batch.end()
+	);
+	if (landing_batch.empty()) {
+		return;
+	}
+	if (landing_batch.size() > 1) {
+		count(COUNTER_LANDING_BATCHES);
+	}
+	if (is_tracing()) {
+		for (const landing& landed : landing_batch) {
+			if (landed.rank != 0) {
+				trace_ranked(info, landed.loadable, landed.rank);
+			}
+		}
+	}
+	
+	unsigned int chosen = choose_landings(landing_batch, info.load_capacity - info.loaded_volume, packing_mode);
+	PLUGIN_LOG(LEVEL_DEBUG, CATEGORY_LOADING, "minecart {}: loading {} of {} landed items", info.id, chosen, landing_batch.size());
+	for (unsigned int i = 0; i != chosen; ++i) {
+		// loaded_volume is updated as each load is queued, so other minecarts this update see the new total
+		const Loadable& loadable = landing_batch[i].loadable;
+		if (loadable.load(info) && is_tracing()) {
+			trace_load_decision(info, loadable);
+		}
+	}
+	count(COUNTER_REJECTED_CAPACITY, landing_batch.size() - chosen);
+	landing_batch.clear();
+}
+
+void perform_minecart_loading() {
+	// loads any items that should be loaded into minecarts because:
+	// * they have fallen from above
+	// * they fit in the minecart, chosen among the others that landed on it at the same time by resolve_landings
+	// the items are loaded together at the end, by commit_item_loads
+	PLUGIN_LOG(LEVEL_TRACE, CATEGORY_LOADING, "perform_minecart_loading");
+	
+	// horizon_ticks: as the paths were predicted with by the last update_minecart_info
+	unsigned int horizon_ticks = std::max(lookahead_ticks, update_interval);
+	for (minecart_info& info : minecarts) {
+		// a sleeping minecart has nothing recorded above it
+		if (info.asleep) {
+			continue;
+		}
+		
+		// the minecart item may have been destroyed since the last update, before update_minecart_list has dropped its vehicle
+		df::item* minecart_item = info.minecart_item.get();
+		if (minecart_item == nullptr) {
+			continue;
+		}
+		df::coord current_pos = Items::getPosition(minecart_item);
+		
+		// DF may have unloaded the minecart since the last update
+		revalidate_loaded_volume(info);
+		refresh_filter(info);
+		
+		unsigned int crossed = count_crossed_tiles(info, current_pos);
+		
+		PLUGIN_LOG(LEVEL_TRACE, CATEGORY_LOADING, "minecart {} at {} crossed {} path tiles", info.id, current_pos, crossed);
+		
+		for (unsigned int tile = 0; tile != crossed; ++tile) {
+			// above_set: the loadables that were *last recorded* being above a tile the minecart has since been on
+			loadable_span above_set = info.above_path[tile];
+			
+			if (above_set.count != 0) {
+				PLUGIN_LOG(LEVEL_DEBUG, CATEGORY_LOADING, "minecart {}: {} loadables were above {}", info.id, above_set.count, info.path[tile]);
+			}
+			
+			for (uint32_t i = 0; i != above_set.count; ++i) {
+				const Loadable& loadable = loadable_arena[above_set.first + i];
+				// if item has fallen onto the tile since the last update, while the minecart was passing through it
+				// it is taken to have landed the tick after it was seen above, as an object falling a level without delay would
+				if (loadable.pos() == info.path[tile]) {
+					if (!passes_filter(info, loadable)) {
+						continue;
+					}
+					if (!was_on_tile(info, tile, crossed, 1, horizon_ticks)) {
+						count(COUNTER_REJECTED_TIMING);
+						continue;
+					}
+					PLUGIN_LOG(LEVEL_DEBUG, CATEGORY_LOADING, "loadable of kind {} fell onto minecart {}", int(loadable.kind()), info.id);
+					on_landed(info, loadable, loadable.kind() == Loadable::ITEM ? loadable.item()->getVolume() : 0);
+				}
+			}
+			
+			// incoming_set: the objects that were *last staged* falling down the column above the tile, which may have
+			// landed since without passing through the tile above while it was being watched
+			loadable_span incoming_set = info.incoming_path[tile];
+			for (uint32_t i = 0; i != incoming_set.count; ++i) {
+				const incoming_load& incoming = incoming_arena[incoming_set.first + i];
+				if (incoming.loadable.pos() == info.path[tile]) {
+					if (!passes_filter(info, incoming.loadable)) {
+						continue;
+					}
+					int32_t tick = get_landing_tick(info, incoming.arrival_tick, world->frame_counter);
+					if (!was_on_tile(info, tile, crossed, tick, horizon_ticks)) {
+						count(COUNTER_REJECTED_TIMING);
+						continue;
+					}
+					PLUGIN_LOG(LEVEL_DEBUG, CATEGORY_LOADING, "staged loadable of kind {} landed on minecart {} by tick {}, estimated for tick {}",
+						int(incoming.loadable.kind()), info.id, world->frame_counter, incoming.arrival_tick);
+					count(COUNTER_INCOMING_LANDED);
+					// for items, with the volume resolved when staged
+					on_landed(info, incoming.loadable, incoming.volume);
+				}
+			}
+		}
+		
+		resolve_landings(info);
+	}
+	
+	commit_item_loads();
+}
+
+void update_minecart_info() {
+	// updates the info recorded for each minecart being tracked
+	// done in three stages, so that the world is only scanned once however many minecarts there are:
+	// * record each minecart's position and advance its predicted path, and watch the tiles above the path and follow the columns
+	// * fill the contents of all watched tiles in one pass, or from the objects recorded by the movement interposes,
+	//   then stage the projectiles falling down the columns
+	// * hand each minecart the shared contents of its watched tiles and columns
+	// sleeping minecarts only get their wake check, so the cost of an update follows the number of awake minecarts
+	// when pipelining, the first stage is mostly done ahead of time, and only checked here
+	PLUGIN_LOG(LEVEL_TRACE, CATEGORY_WATCH, "update_minecart_info");
+	++info_update;
+	
+	// horizon_ticks: the path must reach at least as far as the minecart can get before the next update
+	unsigned int horizon_ticks = std::max(lookahead_ticks, update_interval);
+	bool planned = take_plan(horizon_ticks);
+	if (!planned) {
+		clear_watched_tiles();
+		clear_columns();
+	}
+	find_projectile_blocks();
+	bool prefiltering = is_prefiltering();
+	want_nothing();
+	
+	for (minecart_info& info : minecarts) {
+		// the minecart item is resolved through its handle, so no lookup is needed unless items have come or gone
+		df::item* minecart_item = info.minecart_item.get();
+		if (minecart_item == nullptr) {
+			continue;
+		}
+		df::coord current_pos = Items::getPosition(minecart_item);
+		
+		if (info.asleep) {
+			if (!should_wake(info, current_pos)) {
+				// its column is followed all the same, so that an object falling from too high to wake it is staged for it
+				if (info.path_length != 0) {
+					follow_column(info.path[0]);
+				}
+				continue;
+			}
+			PLUGIN_LOG(LEVEL_DEBUG, CATEGORY_SCHEDULE, "minecart {} wakes at {}", info.id, current_pos);
+			info.asleep = false;
+			info.idle_updates = 0;
+		}
+		
+		info.pos = current_pos;
+		info.path_tick = world->frame_counter;
+		refresh_filter(info);
+		add_wanted(info.filter);
+		// plan: the plan made for the minecart, if any; one it follows gives it its path, so its own is not advanced
+		cart_plan* plan = planned ? find_plan(info.id) : nullptr;
+		if (plan != nullptr && follows_plan(*plan, current_pos, get_motion(info.minecart))) {
+			take_planned_path(info, *plan);
+			PLUGIN_LOG(LEVEL_TRACE, CATEGORY_WATCH, "minecart {} at {}: planned path of {} tiles", info.id, current_pos, info.path_length);
+			count(COUNTER_PLANS_FOLLOWED);
+			count(COUNTER_PLANS_KEPT);
+			continue;
+		}
+		advance_path(info, current_pos, horizon_ticks);
+		
+		PLUGIN_LOG(LEVEL_TRACE, CATEGORY_WATCH, "minecart {} at {}: path of {} tiles", info.id, current_pos, info.path_length);
+		// a minecart sweeping the tiles of its plan has them watched and their columns followed already
+		if (planned) {
+			if (plan != nullptr && sweeps_plan(info, *plan)) {
+				plan->settled = true;
+				count(COUNTER_PLANS_KEPT);
+				continue;
+			}
+			if (plan != nullptr) {
+				release_plan(*plan);
+			}
+			count(COUNTER_PLANS_MISSED);
+		}
+		
+		for (unsigned int i = 0; i != info.path_length; ++i) {
+			follow_column(info.path[i]);
+			df::coord above = info.path[i] + df::coord(0, 0, 1);
+			// a tile left unwatched has nothing recorded above it, which is what a fill would have found
+			if (prefiltering && !may_hold_loadable(above)) {
+				count(COUNTER_TILES_PREFILTERED);
+				continue;
+			}
+			watch_tile(above);
+		}
+	}
+	if (planned) {
+		release_unsettled_plans();
+	}
+	
+	// complete: whether the fill considered every object, rather than only those in the air
+	bool complete = false;
+	if (detection_mode == DETECTION_EVENTS) {
+		fill_watched_tiles_from_events();
+	} else {
+		complete = fill_watched_tiles_by_polling();
+	}
+	if (verify_enabled) {
+		verify_fill(complete);
+	}
+	fill_columns();
+	PLUGIN_LOG(LEVEL_TRACE, CATEGORY_WATCH, "update_minecart_info: {} watched tiles, {} loadables, {} buffer growths", watched_tiles.size(), loadable_arena.size(), buffer_growths.load());
+	
+	for (minecart_info& info : minecarts) {
+		if (info.asleep) {
+			// a sleeping minecart with an object staged in its column is woken, and handed it like an awake one; it is
+			// stationary, so its one-tile path stays right, and its tile above is watched from the next update
+			if (info.path_length == 0 || get_incoming_at(info.path[0]).count == 0) {
+				continue;
+			}
+			PLUGIN_LOG(LEVEL_DEBUG, CATEGORY_SCHEDULE, "minecart {} wakes for an object falling toward {}", info.id, info.pos);
+			count(COUNTER_COLUMN_WAKES);
+			info.asleep = false;
+			info.idle_updates = 0;
+			info.path_tick = world->frame_counter;
+		}
+		
+		for (unsigned int i = 0; i != info.path_length; ++i) {
+			info.above_path[i] = get_loadables_at(info.path[i] + df::coord(0, 0, 1));
+			info.incoming_path[i] = get_incoming_at(info.path[i]);
+			
+			if (info.above_path[i].count != 0) {
+				PLUGIN_LOG(LEVEL_DEBUG, CATEGORY_WATCH, "minecart {}: {} loadables above {}", info.id, info.above_path[i].count, info.path[i]);
+			}
+		}
+		
+		update_sleep_state(info);
+	}
+	
+	if (pipelining) {
+		post_plan(horizon_ticks);
+	}
+}
+
+// counter: counter to next update
+unsigned int counter;
+
+command_result log_command(color_ostream& out, std::vector<std::string>& parameters) {
+	// console subcommand "log": query or configure logging
+	static const char* const LEVEL_NAMES[] = {"off", "error", "info", "debug", "trace"};
+	static const struct {
+		const char* name;
+		log_category_t category;
+	} CATEGORY_NAMES[] = {
+		{"general", CATEGORY_GENERAL},
+		{"registry", CATEGORY_REGISTRY},
+		{"watch", CATEGORY_WATCH},
+		{"loading", CATEGORY_LOADING},
+		{"schedule", CATEGORY_SCHEDULE},
+		{"verify", CATEGORY_VERIFY},
+		{"all", CATEGORY_ALL}
+	};
+	
+	if (parameters.size() == 1) {
+		out.print("log level: %s\n", LEVEL_NAMES[log_level.load()]);
+		for (const auto& entry : CATEGORY_NAMES) {
+			if (entry.category != CATEGORY_ALL) {
+				out.print("  %s: %s\n", entry.name, (log_categories.load() & entry.category) ? "on" : "off");
+			}
+		}
+		out.print("logfile: %s\n", LOGFILE_NAME);
+		return CR_OK;
+	}
+	
+	if (parameters[1] == "level" && parameters.size() == 3) {
+		for (int level = LEVEL_OFF; level <= LEVEL_TRACE; ++level) {
+			if (parameters[2] == LEVEL_NAMES[level]) {
+				log_level.store(level);
+				return CR_OK;
+			}
+		}
+		return CR_WRONG_USAGE;
+	}
+	
+	if (parameters[1] == "category" && parameters.size() == 4) {
+		for (const auto& entry : CATEGORY_NAMES) {
+			if (parameters[2] == entry.name) {
+				if (parameters[3] == "on") {
+					log_categories.fetch_or(entry.category);
+				} else if (parameters[3] == "off") {
+					log_categories.fetch_and(~uint32_t(entry.category));
+				} else {
+					return CR_WRONG_USAGE;
+				}
+				return CR_OK;
+			}
+		}
+		return CR_WRONG_USAGE;
+	}
+	
+	return CR_WRONG_USAGE;
+}
+
+command_result filter_command(color_ostream& out, std::vector<std::string>& parameters) {
+	// console subcommand "filter": list, set or clear the loading filters
+	if (parameters.size() == 1) {
+		if (route_filters.empty() && cart_filters.empty()) {
+			out.print("filter: none\n");
+		}
+		for (const auto& entry : route_filters) {
+			out.print("filter: route %d: %s\n", entry.first, entry.second.text.c_str());
+		}
+		for (const auto& entry : cart_filters) {
+			out.print("filter: cart %d: %s\n", entry.first, entry.second.text.c_str());
+		}
+		return CR_OK;
+	}
+	
+	unsigned int id;
+	if (parameters.size() < 4 || (parameters[1] != "route" && parameters[1] != "cart") || !parse_uint(parameters[2], id)) {
+		return CR_WRONG_USAGE;
+	}
+	bool for_route = parameters[1] == "route";
+	// filters are kept with the save, so there must be one loaded
+	if (!active) {
+		out.printerr("filter: no map is loaded\n");
+		return CR_FAILURE;
+	}
+	
+	if (parameters.size() == 4 && parameters[3] == "clear") {
+		clear_filter(for_route, int32_t(id));
+		return CR_OK;
+	}
+	
+	std::string text = parameters[3];
+	for (size_t i = 4; i != parameters.size(); ++i) {
+		text += " " + parameters[i];
+	}
+	std::string error;
+	if (!set_filter(for_route, int32_t(id), text, error)) {
+		out.printerr("filter: %s\n", error.c_str());
+		return CR_FAILURE;
+	}
+	return CR_OK;
+}
+
+command_result minecart_fall_loading_command(color_ostream& out, std::vector<std::string>& parameters) {
+	// console command: query or configure the plugin
+	CoreSuspender suspend;
+	finish_plan();
+	
+	if (parameters.empty()) {
+		out.print("minecart_fall_loading: %s\n", active ? "active" : "inactive");
+		out.print("  mode: %s\n", detection_mode == DETECTION_EVENTS ? "events" : "polling");
+		out.print("  polling source: %s\n", scan_source == SCAN_ALL ? "all" : "projectiles");
+		out.print("  polling sweep interval: %u\n", sweep_interval);
+		out.print("  polling occupancy prefilter: %s\n", occupancy_prefilter ? "on" : "off");
+		out.print("  scan threads: %u\n", scan_pool.size() + 1);
+		out.print("  snapshot refresh: %u\n", snapshot_refresh);
+		out.print("  block tracking: %s\n", block_tracking ? "on" : "off");
+		out.print("  update interval: %u\n", update_interval);
+		out.print("  sleep after: %u\n", sleep_after);
+		out.print("  lookahead: %u\n", lookahead_ticks);
+		out.print("  column height: %u\n", column_height);
+		out.print("  packing: %s\n", PACKING_MODE_NAMES[packing_mode]);
+		out.print("  pipelining: %s\n", pipelining ? "on" : "off");
+		out.print("  loading filters: %zu\n", route_filters.size() + cart_filters.size());
+		out.print("  tracked minecarts: %zu\n", minecarts.size());
+		out.print("  sleeping minecarts: %zu\n", (size_t)std::count_if(
+			minecarts.begin(),
+			minecarts.end(),
+			[](const minecart_info& info) { return info.asleep; }
+		));
+		out.print("  buffer growths: %llu\n", (unsigned long long)buffer_growths.load());
+		return CR_OK;
+	}
+	
+	if (parameters[0] == "stats") {
+		if (parameters.size() == 1 || (parameters.size() == 2 && parameters[1] == "show")) {
+			print_stats(out);
+			return CR_OK;
+		}
+		if (parameters.size() == 2 && parameters[1] == "reset") {
+			stats = plugin_stats();
+			return CR_OK;
+		}
+		if (parameters.size() == 3 && parameters[1] == "csv") {
+			if (!write_stats_csv(parameters[2])) {
+				out.printerr("minecart_fall_loading: could not write %s\n", parameters[2].c_str());
+				return CR_FAILURE;
+			}
+			return CR_OK;
+		}
+		return CR_WRONG_USAGE;
+	}
+	
+	if (parameters[0] == "log") {
+		return log_command(out, parameters);
+	}
+	
+	if (parameters[0] == "verify") {
+		return verify_command(out, parameters);
+	}
+	
+	if (parameters[0] == "trace") {
+		return trace_command(out, parameters);
+	}
+	
+	if (parameters[0] == "filter") {
+		return filter_command(out, parameters);
+	}
+	
+	if (parameters[0] == "mode" && parameters.size() == 2) {
+		if (parameters[1] == "events") {
+			set_detection_mode(DETECTION_EVENTS);
+		} else if (parameters[1] == "polling") {
+			set_detection_mode(DETECTION_POLLING);
+		} else {
+			return CR_WRONG_USAGE;
+		}
+		return CR_OK;
+	}
+	
+	if (parameters[0] == "source" && parameters.size() == 2) {
+		if (parameters[1] == "all") {
+			scan_source = SCAN_ALL;
+		} else if (parameters[1] == "projectiles") {
+			scan_source = SCAN_PROJECTILES;
+		} else {
+			return CR_WRONG_USAGE;
+		}
+		return CR_OK;
+	}
+	
+	if (parameters[0] == "interval" && parameters.size() == 2) {
+		unsigned int interval;
+		if (!parse_uint(parameters[1], interval) || interval == 0) {
+			return CR_WRONG_USAGE;
+		}
+		update_interval = interval;
+		counter %= update_interval;
+		return CR_OK;
+	}
+	
+	if (parameters[0] == "lookahead" && parameters.size() == 2) {
+		unsigned int ticks;
+		if (!parse_uint(parameters[1], ticks) || ticks == 0) {
+			return CR_WRONG_USAGE;
+		}
+		lookahead_ticks = ticks;
+		return CR_OK;
+	}
+	
+	if (parameters[0] == "column" && parameters.size() == 2) {
+		unsigned int height;
+		if (!parse_uint(parameters[1], height) || height > MAX_COLUMN_HEIGHT) {
+			return CR_WRONG_USAGE;
+		}
+		column_height = height;
+		return CR_OK;
+	}
+	
+	if (parameters[0] == "packing" && parameters.size() == 2) {
+		const char* const* name = std::find(PACKING_MODE_NAMES, PACKING_MODE_NAMES + PACKING_MODE_COUNT, parameters[1]);
+		if (name == PACKING_MODE_NAMES + PACKING_MODE_COUNT) {
+			return CR_WRONG_USAGE;
+		}
+		packing_mode = packing_mode_t(name - PACKING_MODE_NAMES);
+		return CR_OK;
+	}
+	
+	if (parameters[0] == "pipeline" && parameters.size() == 2) {
+		if (parameters[1] == "on") {
+			set_pipelining(true);
+		} else if (parameters[1] == "off") {
+			set_pipelining(false);
+		} else {
+			return CR_WRONG_USAGE;
+		}
+		return CR_OK;
+	}
+	
+	if (parameters[0] == "sleep" && parameters.size() == 2) {
+		if (!parse_uint(parameters[1], sleep_after)) {
+			return CR_WRONG_USAGE;
+		}
+		// with sleeping disabled, nothing may stay asleep
+		if (sleep_after == 0) {
+			for (minecart_info& info : minecarts) {
+				info.asleep = false;
+				info.idle_updates = 0;
+			}
+		}
+		return CR_OK;
+	}
+	
+	if (parameters[0] == "threads" && parameters.size() == 2) {
+		unsigned int threads;
+		if (!parse_uint(parameters[1], threads) || threads == 0 || threads > MAX_SCAN_THREADS) {
+			return CR_WRONG_USAGE;
+		}
+		scan_pool.resize(threads - 1);
+		return CR_OK;
+	}
+	
+	if (parameters[0] == "snapshot" && parameters.size() == 2) {
+		if (!parse_uint(parameters[1], snapshot_refresh)) {
+			return CR_WRONG_USAGE;
+		}
+		// start afresh, whatever was last snapshotted
+		item_snapshot.stale = true;
+		return CR_OK;
+	}
+	
+	if (parameters[0] == "prefilter" && parameters.size() == 2) {
+		if (parameters[1] == "on") {
+			occupancy_prefilter = true;
+		} else if (parameters[1] == "off") {
+			occupancy_prefilter = false;
+		} else {
+			return CR_WRONG_USAGE;
+		}
+		return CR_OK;
+	}
+	
+	if (parameters[0] == "blocks" && parameters.size() == 2) {
+		if (parameters[1] == "on") {
+			block_tracking = true;
+		} else if (parameters[1] == "off") {
+			block_tracking = false;
+			block_records.clear();
+		} else {
+			return CR_WRONG_USAGE;
+		}
+		return CR_OK;
+	}
+	
+	if (parameters[0] == "sweep" && parameters.size() == 2) {
+		if (!parse_uint(parameters[1], sweep_interval)) {
+			return CR_WRONG_USAGE;
+		}
+		sweep_counter = 0;
+		return CR_OK;
+	}
+	
+	return CR_WRONG_USAGE;
+}
+
+void forget_world() {
+	// forgets everything kept about the world being unloaded, so that nothing of it carries over into the next one loaded,
+	// where the same ids may belong to other objects
+	minecarts.clear();
+	minecarts_scratch.clear();
+	++registry_generation;
+	clear_watched_tiles();
+	clear_columns();
+	invalidate_projectile_index();
+	projectile_index.clear();
+	pending_item_loads.clear();
+	landing_batch.clear();
+	event_candidates.clear();
+	event_watched_tiles.clear();
+	block_records.clear();
+	item_snapshot.stale = true;
+	// anything still holding a handle into this world sees its objects as gone
+	++world_generation;
+	end_epoch(item_epoch);
+	end_epoch(unit_epoch);
+	// the plan is of minecarts that are gone
+	plan_posted = false;
+	cart_plans.clear();
+}
+
+DFhackCExport command_result plugin_init(color_ostream& out, std::vector<PluginCommand>& commands) {
+	start_log_writer();
+	PLUGIN_LOG(LEVEL_INFO, CATEGORY_GENERAL, "plugin_init");
+	CoreSuspender suspend;
+	counter = 1;
+	// not active until world is loaded
+	active = false;
+	
+	commands.push_back(PluginCommand(
+		"minecart-fall-loading",
+		"Load items and units that fall onto minecarts.",
+		minecart_fall_loading_command,
+		false,
+		"  minecart-fall-loading\n"
+		"    Print the plugin's status.\n"
+		"  minecart-fall-loading mode polling\n"
+		"    Detect falling objects by scanning every update (default).\n"
+		"  minecart-fall-loading mode events\n"
+		"    Detect falling objects by interposing projectile movement; check it with verify before relying on it.\n"
+		"  minecart-fall-loading source projectiles\n"
+		"    When polling, scan only item projectiles and falling units (default).\n"
+		"  minecart-fall-loading source all\n"
+		"    When polling, scan all items and active units.\n"
+		"  minecart-fall-loading sweep <n>\n"
+		"    When polling projectiles, scan everything every <n>th update anyway; 0 to never (default).\n"
+		"  minecart-fall-loading prefilter <on|off>\n"
+		"    When polling, skip tiles whose map block occupancy shows them empty (default on).\n"
+		"  minecart-fall-loading threads <n>\n"
+		"    Split scans of all items across <n> threads, counting the game's own (default 1).\n"
+		"  minecart-fall-loading snapshot <n>\n"
+		"    Scan all items through a packed snapshot of their positions, fully refreshed every <n> updates; 0 to never (default).\n"
+		"    In between, items on the ground are not re-read, so ones moved other than by falling may be missed.\n"
+		"  minecart-fall-loading blocks <on|off>\n"
+		"    Scan all items by re-reading only changed map blocks under watched tiles (default off).\n"
+		"    Items in buildings, or nested more than one container deep, are then not found.\n"
+		"  minecart-fall-loading filter\n"
+		"    List the loading filters.\n"
+		"  minecart-fall-loading filter <route|cart> <id> <rule>...\n"
+		"    Only load into the minecarts of a route, or a single minecart, what passes the rules; kept with the save.\n"
+		"    Rules: items, no-items, units, no-units, type=<types>, type!=<types>, material=<materials>,\n"
+		"    material!=<materials>, forbidden=<yes|no>, dump=<yes|no>; lists are comma-separated, e.g. type=BOULDER,BAR.\n"
+		"    priority=<types> loads items of the types listed, best first, before any others that land at once.\n"
+		"    A minecart's own filter takes precedence over its route's.\n"
+		"  minecart-fall-loading filter <route|cart> <id> clear\n"
+		"    Remove a loading filter.\n"
+		"  minecart-fall-loading interval <n>\n"
+		"    Update every <n> ticks (default 1).\n"
+		"  minecart-fall-loading lookahead <n>\n"
+		"    Watch the path each minecart will take over the next <n> ticks (default 2).\n"
+		"  minecart-fall-loading column <n>\n"
+		"    Follow objects falling down the <n> levels above each minecart's path (default 30, at most 64); 1 or 0 for only the level above.\n"
+		"  minecart-fall-loading packing <count|volume|arrival>\n"
+		"    Of the items landing on a minecart at once, load as many as fit (count, default), fill the most of its volume (volume),\n"
+		"    or load them in the order found while they fit (arrival).\n"
+		"  minecart-fall-loading pipeline <on|off>\n"
+		"    Plan each update's minecart paths and watched tiles in the background while the game runs, so that the update\n"
+		"    itself only checks them (default off). Not used while the occupancy prefilter applies.\n"
+		"  minecart-fall-loading sleep <n>\n"
+		"    Put minecarts to sleep after <n> idle updates (default 20); 0 to never.\n"
+		"  minecart-fall-loading stats [show]\n"
+		"    Print per-phase timings and counters.\n"
+		"  minecart-fall-loading stats reset\n"
+		"    Reset the timings and counters.\n"
+		"  minecart-fall-loading stats csv <file>\n"
+		"    Write the timings, with full histograms, and counters to <file> as CSV.\n"
+		"  minecart-fall-loading verify [on|off]\n"
+		"    Check every fill of the watched tiles against a brute-force reference scan (default off).\n"
+		"  minecart-fall-loading trace\n"
+		"    Print whether updates are being captured.\n"
+		"  minecart-fall-loading trace start <file>\n"
+		"    Capture the inputs and loading decisions of every update to <file>.\n"
+		"  minecart-fall-loading trace stop\n"
+		"    Stop capturing.\n"
+		"  minecart-fall-loading trace replay <file> [rounds <n>]\n"
+		"    Replay a captured trace, timing it and checking its loading decisions against those captured.\n"
+		"  minecart-fall-loading log\n"
+		"    Print the logging configuration.\n"
+		"  minecart-fall-loading log level <off|error|info|debug|trace>\n"
+		"    Write log statements up to the given level (default info).\n"
+		"  minecart-fall-loading log category <general|registry|watch|loading|schedule|verify|all> <on|off>\n"
+		"    Write or stop writing log statements of the given category.\n"
+	));
+	
+	return CR_OK;
+}
+
+DFhackCExport command_result plugin_onupdate(color_ostream& out) {
+	if (!active) {
+		return CR_OK;
+	}
+	
+	CoreSuspender suspend;
+	
+	// if the counter has loop around to zero
+	if (counter == 0) {
+		PLUGIN_LOG(LEVEL_TRACE, CATEGORY_GENERAL, "plugin_onupdate: updating");
+		phase_timer update_timer(PHASE_UPDATE);
+		// the plan for this update has had the ticks since the last one to be made, so is normally already finished
+		finish_plan();
+		uint64_t growths_before = buffer_growths;
+		
+		// the game has run since the last update, so world->proj_list may have changed, and items or units come and gone
+		invalidate_projectile_index();
+		refresh_handle_epochs();
+		{
+			phase_timer timer(PHASE_UPDATE_MINECART_LIST);
+			update_minecart_list();
+		}
+		if (is_tracing()) {
+			trace_begin_frame();
+		}
+		{
+			phase_timer timer(PHASE_PERFORM_MINECART_LOADING);
+			perform_minecart_loading();
+		}
+		{
+			phase_timer timer(PHASE_UPDATE_MINECART_INFO);
+			update_minecart_info();
+		}
+		if (is_tracing()) {
+			trace_end_frame();
+		}
+		
+		count(COUNTER_UPDATES);
+		uint64_t growths = buffer_growths - growths_before;
+		count(COUNTER_BUFFER_GROWTHS, growths);
+		stats.max_buffer_growths_per_update = std::max(stats.max_buffer_growths_per_update, growths);
+	}
+	
+	// update counter
+	++counter;
+	counter %= update_interval;
+	
+	return CR_OK;
+}
+
+DFhackCExport command_result plugin_shutdown(color_ostream& out) {
+	PLUGIN_LOG(LEVEL_INFO, CATEGORY_GENERAL, "plugin_shutdown");
+	
+	CoreSuspender suspend;
+	
+	apply_event_hooks(false);
+	active = false;
+	scan_pool.resize(0);
+	set_pipelining(false);
+	stop_trace();
+	
+	stop_log_writer();
+	return CR_OK;
+}
+
+DFhackCExport command_result plugin_onstatechange(color_ostream& out, state_change_event event) {
+	PLUGIN_LOG(LEVEL_DEBUG, CATEGORY_GENERAL, "plugin_onstatechange: event {}", event);
+	finish_plan();
+	
+	switch (event) {
+		case SC_MAP_LOADED:
+			// world is loaded
+			// become active
+			active = true;
+			set_detection_mode(detection_mode);
+			load_filters();
+			break;
+		case SC_MAP_UNLOADED:
+			// world is unloaded
+			// become inactive
+			apply_event_hooks(false);
+			active = false;
+			forget_world();
+			stop_trace();
+			route_filters.clear();
+			cart_filters.clear();
+			++filters_generation;
+			break;
+	}
+	
+	return CR_OK;
+}
@@ -0,0 +1,1266 @@
+/*
+The offline target of the minecart_fall_loading plugin: the plugin's own source, built against the stand-in DFHack headers of
+stubs/ and driven from the command line on synthetic worlds, so that it can be checked without DF. Nothing here is part of the
+plugin, which never swaps the fort's objects for synthetic ones.
+*/
+
+#include "../minecart_fall_loading.cpp"
+
+#include <random>
+
+#include "df/item_boulderst.h"
+
+
+
+// Synthetic worlds
+// The update functions themselves are benchmarked and fuzzed on synthetic worlds of stand-in DF objects: items, units, minecarts
+// with their vehicles, projectiles and map_blocks, made with df::allocate and swapped in for the stand-in world's own for as long
+// as a synthetic_world lives. The plugin's per-world state is set aside alongside, so that each run starts afresh.
+// Only the map_blocks something is put in are made; the rest of the synthetic map is left unallocated, which to the plugin is
+// the same as empty.
+
+// SYNTHETIC_MAP_TILES, SYNTHETIC_MAP_LEVELS: the horizontal size and the depth of a synthetic map
+const int16_t SYNTHETIC_MAP_TILES = 192;
+const int16_t SYNTHETIC_MAP_LEVELS = 150;
+
+class synthetic_world {
+	// a synthetic world, swapped in for the stand-in world's items, units, vehicles, projectiles and map for its lifetime, with the
+	// plugin's per-world state set aside; its objects must only be made, moved and destroyed through it, which keeps the
+	// map_blocks and world->proj_list consistent with them. Ids are handed out in ascending order, so the world's vectors stay
+	// sorted by id.
+	public:
+		// <minecart_capacity>: the container capacity of every minecart made
+		explicit synthetic_world(int32_t minecart_capacity);
+		~synthetic_world();
+		
+		// add_item, add_unit: make an object on coord <pos>, in the air if <falling>, else on the ground
+		df::item* add_item(df::coord pos, bool falling);
+		df::unit* add_unit(df::coord pos, bool falling);
+		// add_minecart: makes a stationary minecart, item and vehicle, on coord <pos>
+		df::vehicle* add_minecart(df::coord pos);
+		// move_item, move_unit: move an object onto coord <pos>, in the air if <falling>, else on the ground
+		void move_item(df::item* item, df::coord pos, bool falling);
+		void move_unit(df::unit* unit, df::coord pos, bool falling);
+		// hold_item: moves <item> into the inventory of <unit>, hauled
+		void hold_item(df::unit* unit, df::item* item);
+		// put_item_in: moves <item> inside <container>
+		void put_item_in(df::item* container, df::item* item);
+		void remove_item(df::item* item);
+		void remove_unit(df::unit* unit);
+		void remove_minecart(df::vehicle* minecart);
+		// advance_tick: advances world->frame_counter a tick, as between updates with an update interval of 1
+		void advance_tick();
+	
+	private:
+		df::map_block* get_block(df::coord pos);
+		void link_projectile(df::projectile* proj, df::coord pos);
+		void place_item(df::item* item, df::coord pos, bool falling);
+		void unplace_item(df::item* item);
+		void place_unit(df::unit* unit, df::coord pos, bool falling);
+		void unplace_unit(df::unit* unit);
+		void refresh_occupancy(df::coord pos);
+		
+		live_state_stash stash;
+		// live_items, live_units, live_active_units, live_vehicles, live_projectiles: the world's own, set aside
+		std::vector<df::item*> live_items;
+		std::vector<df::unit*> live_units;
+		std::vector<df::unit*> live_active_units;
+		std::vector<df::vehicle*> live_vehicles;
+		df::proj_list_link* live_projectiles;
+		int32_t live_frame_counter;
+		// live_block_index, live_x_count_block, live_y_count_block, live_z_count_block: the world's own map, set aside
+		df::map_block**** live_block_index;
+		int32_t live_x_count_block;
+		int32_t live_y_count_block;
+		int32_t live_z_count_block;
+		// blocks, block_columns, block_rows: storage of the synthetic block index, x by y by z; blocks are made as needed
+		std::vector<df::map_block*> blocks;
+		std::vector<df::map_block**> block_columns;
+		std::vector<df::map_block***> block_rows;
+		// minecart_def: the tool definition of every synthetic minecart
+		df::itemdef_toolst* minecart_def;
+		// next_id, next_projectile_id: ids of the next object or vehicle made, and of the next projectile
+		int32_t next_id;
+		int32_t next_projectile_id;
+};
+
+synthetic_world::synthetic_world(int32_t minecart_capacity)
+  : live_projectiles(world->proj_list.next),
+    live_frame_counter(world->frame_counter),
+    live_block_index(world->map.block_index),
+    live_x_count_block(world->map.x_count_block),
+    live_y_count_block(world->map.y_count_block),
+    live_z_count_block(world->map.z_count_block),
+    next_id(0),
+    next_projectile_id(0)
+{
+	world->items.all.swap(live_items);
+	world->units.all.swap(live_units);
+	world->units.active.swap(live_active_units);
+	world->vehicles.all.swap(live_vehicles);
+	world->proj_list.next = nullptr;
+	
+	int32_t x_count = SYNTHETIC_MAP_TILES / 16;
+	int32_t y_count = SYNTHETIC_MAP_TILES / 16;
+	int32_t z_count = SYNTHETIC_MAP_LEVELS;
+	blocks.assign(size_t(x_count) * y_count * z_count, nullptr);
+	block_columns.resize(size_t(x_count) * y_count);
+	block_rows.resize(size_t(x_count));
+	for (size_t column = 0; column != block_columns.size(); ++column) {
+		block_columns[column] = blocks.data() + column * z_count;
+	}
+	for (size_t row = 0; row != block_rows.size(); ++row) {
+		block_rows[row] = block_columns.data() + row * y_count;
+	}
+	world->map.block_index = block_rows.data();
+	world->map.x_count_block = x_count;
+	world->map.y_count_block = y_count;
+	world->map.z_count_block = z_count;
+	
+	minecart_def = df::allocate<df::itemdef_toolst>();
+	minecart_def->container_capacity = minecart_capacity;
+}
+
+synthetic_world::~synthetic_world() {
+	for (df::proj_list_link* link = world->proj_list.next; link != nullptr; ) {
+		df::proj_list_link* next = link->next;
+		// as unlink_projectile frees them
+		delete (void*)link->item;
+		delete link;
+		link = next;
+	}
+	for (df::item* item : world->items.all) {
+		delete item;
+	}
+	for (df::unit* unit : world->units.all) {
+		for (df::unit_inventory_item* held : unit->inventory) {
+			delete held;
+		}
+		delete unit;
+	}
+	for (df::vehicle* vehicle : world->vehicles.all) {
+		delete vehicle;
+	}
+	for (df::map_block* block : blocks) {
+		delete block;
+	}
+	delete minecart_def;
+	
+	world->items.all.swap(live_items);
+	world->units.all.swap(live_units);
+	world->units.active.swap(live_active_units);
+	world->vehicles.all.swap(live_vehicles);
+	world->proj_list.next = live_projectiles;
+	world->frame_counter = live_frame_counter;
+	world->map.block_index = live_block_index;
+	world->map.x_count_block = live_x_count_block;
+	world->map.y_count_block = live_y_count_block;
+	world->map.z_count_block = live_z_count_block;
+}
+
+void synthetic_world::advance_tick() {
+	++world->frame_counter;
+}
+
+df::map_block* synthetic_world::get_block(df::coord pos) {
+	// returns the map_block holding coord <pos>, made if it has not been yet, or nullptr if <pos> is off the map
+	if (pos.x < 0 || pos.y < 0 || pos.z < 0 || pos.x >= SYNTHETIC_MAP_TILES || pos.y >= SYNTHETIC_MAP_TILES || pos.z >= SYNTHETIC_MAP_LEVELS) {
+		return nullptr;
+	}
+	df::map_block*& block = world->map.block_index[pos.x / 16][pos.y / 16][pos.z];
+	if (block == nullptr) {
+		block = df::allocate<df::map_block>();
+		block->map_pos = df::coord(pos.x - pos.x % 16, pos.y - pos.y % 16, pos.z);
+	}
+	return block;
+}
+
+void synthetic_world::refresh_occupancy(df::coord pos) {
+	// sets the occupancy of coord <pos> from the items on the ground and the units standing there
+	df::map_block* block = get_map_block(pos);
+	if (block == nullptr) {
+		return;
+	}
+	bool item = std::any_of(block->items.begin(), block->items.end(), [pos](int32_t id) {
+		return df::item::find(id)->pos == pos;
+	});
+	bool unit = std::any_of(world->units.all.begin(), world->units.all.end(), [pos](df::unit* unit) {
+		return !unit->flags1.bits.projectile && unit->pos == pos;
+	});
+	df::tile_occupancy& occupancy = block->occupancy[pos.x % 16][pos.y % 16];
+	occupancy.bits.item = item;
+	occupancy.bits.unit = unit;
+}
+
+void synthetic_world::link_projectile(df::projectile* proj, df::coord pos) {
+	// puts <proj>, on coord <pos>, at the front of world->proj_list
+	proj->id = next_projectile_id++;
+	proj->origin_pos = pos;
+	proj->prev_pos = pos;
+	proj->cur_pos = pos;
+	// in DF, the air a projectile moves through is part of an allocated map_block
+	get_block(pos);
+	df::proj_list_link* link = new df::proj_list_link();
+	link->item = proj;
+	link->prev = &world->proj_list;
+	link->next = world->proj_list.next;
+	if (link->next != nullptr) {
+		link->next->prev = link;
+	}
+	world->proj_list.next = link;
+	invalidate_projectile_index();
+}
+
+void synthetic_world::place_item(df::item* item, df::coord pos, bool falling) {
+	// puts <item>, which must be neither in the air nor on the ground, on coord <pos>
+	item->pos = pos;
+	if (falling) {
+		item->flags.bits.on_ground = false;
+		df::proj_itemst* proj = df::allocate<df::proj_itemst>();
+		proj->item = item;
+		link_projectile(proj, pos);
+		auto ref = df::allocate<df::general_ref_projectile>();
+		ref->projectile_id = proj->id;
+		item->general_refs.push_back(ref);
+		return;
+	}
+	item->flags.bits.on_ground = true;
+	if (df::map_block* block = get_block(pos)) {
+		block->items.push_back(item->id);
+		block->occupancy[pos.x % 16][pos.y % 16].bits.item = true;
+	}
+}
+
+void synthetic_world::unplace_item(df::item* item) {
+	// takes <item> out of the air, off the ground, out of a unit's inventory or out of its container
+	for (size_t i = 0; i != item->general_refs.size(); ++i) {
+		df::general_ref* ref = item->general_refs[i];
+		switch (ref->getType()) {
+			case df::general_ref_type::PROJECTILE:
+				if (df::proj_list_link* link = find_projectile_link(((df::general_ref_projectile*)ref)->projectile_id)) {
+					unlink_projectile(link);
+				}
+				break;
+			case df::general_ref_type::UNIT_HOLDER: {
+				df::unit* holder = df::unit::find(((df::general_ref_unit_holderst*)ref)->unit_id);
+				for (size_t j = 0; j != holder->inventory.size(); ++j) {
+					if (holder->inventory[j]->item == item) {
+						delete holder->inventory[j];
+						vector_erase_at(holder->inventory, j);
+						break;
+					}
+				}
+				break;
+			}
+			case df::general_ref_type::CONTAINED_IN_ITEM: {
+				df::item* container = df::item::find(((df::general_ref_contained_in_itemst*)ref)->item_id);
+				for (size_t j = 0; j != container->general_refs.size(); ++j) {
+					df::general_ref* contains = container->general_refs[j];
+					if (contains->getType() == df::general_ref_type::CONTAINS_ITEM
+						&& ((df::general_ref_contains_itemst*)contains)->item_id == item->id
+					) {
+						vector_erase_at(container->general_refs, j);
+						delete contains;
+						break;
+					}
+				}
+				break;
+			}
+			default:
+				continue;
+		}
+		vector_erase_at(item->general_refs, i);
+		delete ref;
+		item->flags.bits.in_inventory = false;
+		return;
+	}
+	if (item->flags.bits.on_ground) {
+		item->flags.bits.on_ground = false;
+		if (df::map_block* block = get_map_block(item->pos)) {
+			block->items.erase(std::find(block->items.begin(), block->items.end(), item->id));
+			refresh_occupancy(item->pos);
+		}
+	}
+}
+
+void synthetic_world::place_unit(df::unit* unit, df::coord pos, bool falling) {
+	// puts <unit>, which must be neither in the air nor standing, on coord <pos>
+	unit->pos = pos;
+	unit->flags1.bits.projectile = falling;
+	if (falling) {
+		df::proj_unitst* proj = df::allocate<df::proj_unitst>();
+		proj->unit = unit;
+		link_projectile(proj, pos);
+		return;
+	}
+	if (df::map_block* block = get_block(pos)) {
+		block->occupancy[pos.x % 16][pos.y % 16].bits.unit = true;
+	}
+}
+
+void synthetic_world::unplace_unit(df::unit* unit) {
+	// takes <unit> out of the air or off its tile
+	if (unit->flags1.bits.projectile) {
+		unit->flags1.bits.projectile = false;
+		for (df::proj_list_link* link = world->proj_list.next; link != nullptr; link = link->next) {
+			df::proj_unitst* proj = virtual_cast<df::proj_unitst>(link->item);
+			if (proj != nullptr && proj->unit == unit) {
+				unlink_projectile(link);
+				break;
+			}
+		}
+		return;
+	}
+	df::coord pos = unit->pos;
+	unit->pos = df::coord();
+	refresh_occupancy(pos);
+}
+
+df::item* synthetic_world::add_item(df::coord pos, bool falling) {
+	df::item* item = df::allocate<df::item_boulderst>();
+	item->id = next_id++;
+	world->items.all.push_back(item);
+	place_item(item, pos, falling);
+	return item;
+}
+
+df::unit* synthetic_world::add_unit(df::coord pos, bool falling) {
+	df::unit* unit = df::allocate<df::unit>();
+	unit->id = next_id++;
+	world->units.all.push_back(unit);
+	world->units.active.push_back(unit);
+	place_unit(unit, pos, falling);
+	return unit;
+}
+
+df::vehicle* synthetic_world::add_minecart(df::coord pos) {
+	df::item_toolst* item = df::allocate<df::item_toolst>();
+	item->id = next_id++;
+	item->subtype = minecart_def;
+	world->items.all.push_back(item);
+	place_item(item, pos, false);
+	
+	df::vehicle* minecart = df::allocate<df::vehicle>();
+	minecart->id = next_id++;
+	minecart->item_id = item->id;
+	minecart->route_id = -1;
+	world->vehicles.all.push_back(minecart);
+	return minecart;
+}
+
+void synthetic_world::move_item(df::item* item, df::coord pos, bool falling) {
+	unplace_item(item);
+	place_item(item, pos, falling);
+}
+
+void synthetic_world::move_unit(df::unit* unit, df::coord pos, bool falling) {
+	unplace_unit(unit);
+	place_unit(unit, pos, falling);
+}
+
+void synthetic_world::hold_item(df::unit* unit, df::item* item) {
+	unplace_item(item);
+	item->flags.bits.in_inventory = true;
+	df::unit_inventory_item* held = df::allocate<df::unit_inventory_item>();
+	held->item = item;
+	held->mode = df::unit_inventory_item::Hauled;
+	unit->inventory.push_back(held);
+	auto ref = df::allocate<df::general_ref_unit_holderst>();
+	ref->unit_id = unit->id;
+	item->general_refs.push_back(ref);
+}
+
+void synthetic_world::put_item_in(df::item* container, df::item* item) {
+	unplace_item(item);
+	item->flags.bits.in_inventory = true;
+	auto contains = df::allocate<df::general_ref_contains_itemst>();
+	contains->item_id = item->id;
+	container->general_refs.push_back(contains);
+	auto contained_in = df::allocate<df::general_ref_contained_in_itemst>();
+	contained_in->item_id = container->id;
+	item->general_refs.push_back(contained_in);
+}
+
+void synthetic_world::remove_item(df::item* item) {
+	// whatever is inside <item> is dropped where it is
+	std::vector<df::item*> contents;
+	Items::getContainedItems(item, &contents);
+	for (df::item* contained : contents) {
+		move_item(contained, Items::getPosition(item), false);
+	}
+	unplace_item(item);
+	std::vector<df::item*>& items = world->items.all;
+	items.erase(std::find(items.begin(), items.end(), item));
+	delete item;
+}
+
+void synthetic_world::remove_unit(df::unit* unit) {
+	// whatever <unit> holds is dropped where it stands
+	while (!unit->inventory.empty()) {
+		move_item(unit->inventory.back()->item, unit->pos, false);
+	}
+	unplace_unit(unit);
+	for (std::vector<df::unit*>* units : {&world->units.all, &world->units.active}) {
+		units->erase(std::find(units->begin(), units->end(), unit));
+	}
+	delete unit;
+}
+
+void synthetic_world::remove_minecart(df::vehicle* minecart) {
+	if (df::item* item = get_minecart_item(minecart)) {
+		remove_item(item);
+	}
+	std::vector<df::vehicle*>& vehicles = world->vehicles.all;
+	vehicles.erase(std::find(vehicles.begin(), vehicles.end(), minecart));
+	delete minecart;
+}
+
+
+// Benchmarks
+// The scan paths are benchmarked by the bench subcommand on a synthetic world: generated minecarts, each with its own vehicle,
+// are run through the same path, watch, fill and lookup functions as real ones, against generated item positions. The update
+// stages themselves are then timed on a synthetic_world made from the same minecarts and positions, in which the falling items
+// drop a level every round, so that some land on the minecarts below and are loaded into them; one DF item is made per generated
+// item. The plugin's per-world state and stats are set aside while benchmarking, so that each world starts afresh.
+
+struct bench_config {
+	// item_count: number of items in the synthetic world
+	unsigned int item_count;
+	// cart_count: number of minecarts, shared out between the shafts
+	unsigned int cart_count;
+	// shaft_count: number of vertical shafts, each with a track at its bottom along which its minecarts run
+	unsigned int shaft_count;
+	// projectile_permille: of every 1000 items, the number falling down a shaft; the rest lie anywhere on the map
+	unsigned int projectile_permille;
+	// rounds: number of updates timed for each kernel
+	unsigned int rounds;
+};
+
+// BENCH_SHAFT_HEIGHT: height of a shaft above its track
+const int16_t BENCH_SHAFT_HEIGHT = 20;
+
+struct bench_world {
+	// a synthetic world, generated by make_bench_world
+	// vehicles: the minecarts' vehicles, referred to by carts[i].minecart; never reallocated once the carts are made
+	std::vector<df::vehicle> vehicles;
+	std::vector<minecart_info> carts;
+	std::vector<df::coord> item_pos;
+	// projectiles: indices into item_pos of the items falling down a shaft
+	std::vector<uint32_t> projectiles;
+	// floors: for each of projectiles, the level of its shaft's track, on which it lands
+	std::vector<int16_t> floors;
+};
+
+void make_bench_world(const bench_config& config, uint32_t seed, bench_world& bench) {
+	// generates into <bench> a synthetic world according to <config>, deterministically from <seed>
+	std::mt19937 rng(seed);
+	auto uniform = [&rng](int32_t low, int32_t high) {
+		return std::uniform_int_distribution<int32_t>(low, high)(rng);
+	};
+	
+	unsigned int shaft_count = std::max(config.shaft_count, 1u);
+	std::vector<df::coord> shafts;
+	for (unsigned int i = 0; i != shaft_count; ++i) {
+		shafts.push_back(df::coord(
+			uniform(8, SYNTHETIC_MAP_TILES - 9),
+			uniform(8, SYNTHETIC_MAP_TILES - 9),
+			uniform(0, SYNTHETIC_MAP_LEVELS - BENCH_SHAFT_HEIGHT - 1)
+		));
+	}
+	
+	bench.vehicles.assign(config.cart_count, df::vehicle());
+	bench.carts.clear();
+	for (unsigned int i = 0; i != config.cart_count; ++i) {
+		// each minecart runs back and forth along its shaft's track, somewhere near the shaft
+		df::coord shaft = shafts[i % shaft_count];
+		df::vehicle& vehicle = bench.vehicles[i];
+		vehicle.id = int32_t(i);
+		vehicle.offset_x = uniform(-49999, 49999);
+		vehicle.offset_y = 0;
+		vehicle.offset_z = 0;
+		vehicle.speed_x = uniform(-40000, 40000);
+		vehicle.speed_y = 0;
+		vehicle.speed_z = 0;
+		
+		minecart_info info = minecart_info();
+		info.id = vehicle.id;
+		info.minecart = &vehicle;
+		info.pos = shaft + df::coord(uniform(-4, 4), 0, 0);
+		bench.carts.push_back(info);
+	}
+	
+	bench.item_pos.clear();
+	bench.projectiles.clear();
+	bench.floors.clear();
+	bench.item_pos.reserve(config.item_count);
+	for (unsigned int i = 0; i != config.item_count; ++i) {
+		if (unsigned(uniform(0, 999)) < config.projectile_permille) {
+			df::coord shaft = shafts[uniform(0, int32_t(shaft_count) - 1)];
+			bench.projectiles.push_back(i);
+			bench.floors.push_back(shaft.z);
+			bench.item_pos.push_back(shaft + df::coord(0, 0, uniform(1, BENCH_SHAFT_HEIGHT)));
+		} else {
+			bench.item_pos.push_back(df::coord(
+				uniform(0, SYNTHETIC_MAP_TILES - 1),
+				uniform(0, SYNTHETIC_MAP_TILES - 1),
+				uniform(0, SYNTHETIC_MAP_LEVELS - 1)
+			));
+		}
+	}
+}
+
+inline Loadable make_synthetic_loadable(Loadable::kind_t kind, uint32_t id) {
+	// returns a stand-in loadable of kind <kind> for synthetic object <id>; it is only ever compared and copied, never resolved
+	return Loadable(kind, int32_t(id));
+}
+
+enum bench_kernel_t {
+	// BENCH_WATCH: update_minecart_info's first stage: advance every path and watch the tiles above it
+	BENCH_WATCH,
+	// BENCH_SCAN_ALL: fill the watched tiles from every item, as when polling with source all
+	BENCH_SCAN_ALL,
+	// BENCH_SCAN_ALL_PARALLEL: the same, split into chunks across the scan threads
+	BENCH_SCAN_ALL_PARALLEL,
+	// BENCH_SCAN_SNAPSHOT: the same, matching a snapshot of the items' positions
+	BENCH_SCAN_SNAPSHOT,
+	// BENCH_SCAN_PROJECTILES: fill the watched tiles from falling items only, as when polling with source projectiles
+	BENCH_SCAN_PROJECTILES,
+	// BENCH_LOOKUP: hand each minecart its watched tiles' contents and walk them as perform_minecart_loading would
+	BENCH_LOOKUP,
+	// BENCH_MINECART_LIST, BENCH_MINECART_LOADING, BENCH_MINECART_INFO: the update stages, in the order of an update, on the
+	// synthetic_world; loading includes committing the loads
+	BENCH_MINECART_LIST,
+	BENCH_MINECART_LOADING,
+	BENCH_MINECART_INFO,
+	BENCH_KERNEL_COUNT
+};
+
+const char* const BENCH_KERNEL_NAMES[BENCH_KERNEL_COUNT] = {
+	"watch",
+	"scan_all",
+	"scan_all_parallel",
+	"scan_snapshot",
+	"scan_projectiles",
+	"lookup",
+	"minecart_list",
+	"minecart_loading",
+	"minecart_info"
+};
+
+// BENCH_MINECART_CAPACITY: the capacity of the minecarts of a synthetic_world benchmarked, large enough that they never fill
+const int32_t BENCH_MINECART_CAPACITY = INT32_MAX / 2;
+
+struct bench_result {
+	// total_ns: time taken by all rounds of each kernel
+	uint64_t total_ns[BENCH_KERNEL_COUNT];
+	// matches: loadables found on watched tiles by the last round; reported so the work cannot be optimised away
+	uint64_t matches;
+	// loaded: items loaded into minecarts by all rounds of the update stages
+	uint64_t loaded;
+};
+
+uint64_t run_stage_bench(const bench_config& config, const bench_world& bench,
+	const std::function<void(bench_kernel_t, const std::function<void()>&)>& time) {
+	// times the update stages over <config>.rounds updates of a synthetic_world made from <bench>, through <time>, and returns
+	// how many items they loaded
+	// between updates, each minecart rolls on and each falling item drops a level; one that has landed, whether loaded or not, is
+	// dropped down its shaft again, so that loading goes on for as long as the rounds do
+	synthetic_world synthetic(BENCH_MINECART_CAPACITY);
+	// rolling: the minecarts, each rolling back and forth along its track, from <min_x> to <max_x>
+	struct rolling_minecart {
+		df::vehicle* minecart;
+		df::item* item;
+		int16_t min_x;
+		int16_t max_x;
+	};
+	std::vector<rolling_minecart> rolling;
+	for (size_t i = 0; i != bench.carts.size(); ++i) {
+		df::coord pos = bench.carts[i].pos;
+		df::vehicle* minecart = synthetic.add_minecart(pos);
+		minecart->offset_x = bench.vehicles[i].offset_x;
+		minecart->speed_x = bench.vehicles[i].speed_x;
+		rolling.push_back(rolling_minecart{minecart, world->items.all.back(), int16_t(pos.x - 4), int16_t(pos.x + 4)});
+	}
+	// falling: the falling items, with the level of their shaft's track and the height they are dropped again from
+	struct falling_item {
+		df::item* item;
+		int16_t floor;
+		int16_t top;
+	};
+	std::vector<falling_item> falling;
+	auto next_projectile = bench.projectiles.begin();
+	for (uint32_t i = 0; i != bench.item_pos.size(); ++i) {
+		bool is_projectile = next_projectile != bench.projectiles.end() && *next_projectile == i;
+		df::item* item = synthetic.add_item(bench.item_pos[i], is_projectile);
+		if (is_projectile) {
+			int16_t floor = bench.floors[next_projectile - bench.projectiles.begin()];
+			falling.push_back(falling_item{item, floor, int16_t(floor + BENCH_SHAFT_HEIGHT)});
+			++next_projectile;
+		}
+	}
+	
+	for (unsigned int round = 0; round != config.rounds; ++round) {
+		synthetic.advance_tick();
+		for (const rolling_minecart& roll : rolling) {
+			df::coord pos = roll.item->pos;
+			int32_t offset = roll.minecart->offset_x + roll.minecart->speed_x;
+			for (; offset >= 50000; offset -= 100000) {
+				++pos.x;
+			}
+			for (; offset < -50000; offset += 100000) {
+				--pos.x;
+			}
+			roll.minecart->offset_x = offset;
+			if ((pos.x >= roll.max_x && roll.minecart->speed_x > 0) || (pos.x <= roll.min_x && roll.minecart->speed_x < 0)) {
+				roll.minecart->speed_x = -roll.minecart->speed_x;
+			}
+			if (pos != roll.item->pos) {
+				synthetic.move_item(roll.item, pos, false);
+			}
+		}
+		for (const falling_item& fall : falling) {
+			df::coord pos = fall.item->pos;
+			if (is_falling(fall.item)) {
+				--pos.z;
+				synthetic.move_item(fall.item, pos, pos.z != fall.floor);
+			} else if (fall.item->flags.bits.on_ground || fall.item->flags.bits.in_inventory) {
+				// a loaded item is still where it landed, above its shaft's track
+				pos.z = fall.top;
+				synthetic.move_item(fall.item, pos, true);
+			}
+		}
+		// as at the start of a real update
+		invalidate_projectile_index();
+		refresh_handle_epochs();
+		time(BENCH_MINECART_LIST, update_minecart_list);
+		time(BENCH_MINECART_LOADING, perform_minecart_loading);
+		time(BENCH_MINECART_INFO, update_minecart_info);
+	}
+	return stats.counters[COUNTER_ITEMS_LOADED];
+}
+
+bench_result run_bench(const bench_config& config, bench_world& bench) {
+	// times each kernel over <config>.rounds updates of synthetic world <bench>
+	// uses the global watched tile storage, which the caller must have set aside
+	bench_result result = {};
+	unsigned int horizon_ticks = std::max(lookahead_ticks, update_interval);
+	
+	// snapshot: the synthetic items never move, so the snapshot is taken once rather than refreshed
+	position_snapshot snapshot = position_snapshot();
+	resize_snapshot(snapshot, bench.item_pos.size());
+	for (size_t i = 0; i != bench.item_pos.size(); ++i) {
+		set_snapshot_pos(snapshot, i, bench.item_pos[i]);
+	}
+	std::vector<uint32_t> candidates;
+	
+	auto time = [&result](bench_kernel_t kernel, const std::function<void()>& body) {
+		auto start = std::chrono::steady_clock::now();
+		body();
+		auto elapsed = std::chrono::steady_clock::now() - start;
+		result.total_ns[kernel] += uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+	};
+	
+	for (unsigned int round = 0; round != config.rounds; ++round) {
+		time(BENCH_WATCH, [&]() {
+			clear_watched_tiles();
+			for (minecart_info& info : bench.carts) {
+				advance_path(info, info.pos, horizon_ticks);
+				for (unsigned int i = 0; i != info.path_length; ++i) {
+					watch_tile(info.path[i] + df::coord(0, 0, 1));
+				}
+			}
+		});
+		
+		time(BENCH_SCAN_ALL, [&]() {
+			for (uint32_t i = 0; i != bench.item_pos.size(); ++i) {
+				record_match(bench.item_pos[i], make_synthetic_loadable(Loadable::ITEM, i));
+			}
+			group_tile_matches();
+		});
+		
+		time(BENCH_SCAN_ALL_PARALLEL, [&]() {
+			record_matches_in_parallel(bench.item_pos.size(), [&](size_t begin, size_t end, std::vector<tile_match>& matches) {
+				for (size_t i = begin; i != end; ++i) {
+					uint32_t slot = watched_tiles.find(bench.item_pos[i]);
+					if (slot != coord_table::npos) {
+						matches.push_back(tile_match{slot, make_synthetic_loadable(Loadable::ITEM, uint32_t(i))});
+					}
+				}
+			});
+			group_tile_matches();
+		});
+		
+		time(BENCH_SCAN_SNAPSHOT, [&]() {
+			snapshot_filter filter;
+			build_snapshot_filter(watched_tiles, filter);
+			candidates.clear();
+			match_snapshot(snapshot, filter, watched_tiles, 0, snapshot.count, candidates);
+			for (uint32_t i : candidates) {
+				record_match(bench.item_pos[i], make_synthetic_loadable(Loadable::ITEM, i));
+			}
+			group_tile_matches();
+		});
+		
+		time(BENCH_SCAN_PROJECTILES, [&]() {
+			for (uint32_t i : bench.projectiles) {
+				record_match(bench.item_pos[i], make_synthetic_loadable(Loadable::ITEM, i));
+			}
+			group_tile_matches();
+		});
+		
+		time(BENCH_LOOKUP, [&]() {
+			result.matches = 0;
+			for (minecart_info& info : bench.carts) {
+				for (unsigned int i = 0; i != info.path_length; ++i) {
+					info.above_path[i] = get_loadables_at(info.path[i] + df::coord(0, 0, 1));
+				}
+				for (unsigned int tile = 0; tile != info.path_length; ++tile) {
+					loadable_span above_set = info.above_path[tile];
+					for (uint32_t i = 0; i != above_set.count; ++i) {
+						result.matches += loadable_arena[above_set.first + i].kind() == Loadable::ITEM;
+					}
+				}
+			}
+		});
+	}
+	
+	result.loaded = run_stage_bench(config, bench, time);
+	return result;
+}
+
+void print_bench_result(color_ostream& out, const bench_config& config, const bench_world& bench, const bench_result& result) {
+	// prints <result> of benchmarking <bench>, generated from <config>, to console <out>
+	out.print("%u items (%zu falling), %u minecarts, %u shafts, %u rounds, %u scan threads: %llu matches, %llu loaded\n",
+		config.item_count, bench.projectiles.size(), config.cart_count, config.shaft_count, config.rounds, scan_pool.size() + 1,
+		(unsigned long long)result.matches, (unsigned long long)result.loaded
+	);
+	for (unsigned int kernel = 0; kernel != BENCH_KERNEL_COUNT; ++kernel) {
+		// elements: what the kernel's throughput is measured in
+		size_t elements = config.cart_count;
+		if (kernel == BENCH_SCAN_ALL || kernel == BENCH_SCAN_ALL_PARALLEL || kernel == BENCH_SCAN_SNAPSHOT) {
+			elements = bench.item_pos.size();
+		} else if (kernel == BENCH_SCAN_PROJECTILES) {
+			elements = bench.projectiles.size();
+		}
+		bool per_minecart = kernel == BENCH_WATCH || kernel == BENCH_LOOKUP || kernel == BENCH_MINECART_LIST
+			|| kernel == BENCH_MINECART_LOADING || kernel == BENCH_MINECART_INFO;
+		double round_ns = double(result.total_ns[kernel]) / std::max(config.rounds, 1u);
+		out.print("  %-18s %12.2f us/update %14.0f %s/s\n",
+			BENCH_KERNEL_NAMES[kernel],
+			round_ns / 1000.0,
+			round_ns > 0 ? elements * 1e9 / round_ns : 0.0,
+			per_minecart ? "minecarts" : "items"
+		);
+	}
+}
+
+command_result bench_command(color_ostream& out, std::vector<std::string>& parameters) {
+	// subcommand "bench [items <n>]... [carts <n>] [shafts <n>] [projectiles <permille>] [rounds <n>]": runs the benchmarks,
+	// by default on worlds of 10000, 100000 and 1000000 items
+	bench_config config = {0, 100, 10, 10, 20};
+	std::vector<unsigned int> item_counts;
+	for (size_t i = 1; i != parameters.size(); i += 2) {
+		unsigned int value;
+		if (i + 1 == parameters.size() || !parse_uint(parameters[i + 1], value)) {
+			return CR_WRONG_USAGE;
+		}
+		if (parameters[i] == "items") {
+			item_counts.push_back(value);
+		} else if (parameters[i] == "carts") {
+			config.cart_count = value;
+		} else if (parameters[i] == "shafts") {
+			config.shaft_count = value;
+		} else if (parameters[i] == "projectiles" && value <= 1000) {
+			config.projectile_permille = value;
+		} else if (parameters[i] == "rounds" && value != 0) {
+			config.rounds = value;
+		} else {
+			return CR_WRONG_USAGE;
+		}
+	}
+	if (item_counts.empty()) {
+		item_counts = {10000, 100000, 1000000};
+	}
+	
+	// the kernels start from empty watched tiles and stats
+	live_state_stash stash;
+	bench_world bench;
+	for (unsigned int item_count : item_counts) {
+		config.item_count = item_count;
+		make_bench_world(config, item_count, bench);
+		print_bench_result(out, config, bench, run_bench(config, bench));
+	}
+	return CR_OK;
+}
+
+
+// Fuzzing
+// The verify mode's reference drives a fuzzer over a synthetic_world whose items, units and minecarts are moved, spawned and
+// destroyed at random, with items picked up by units and put in minecarts, run through the real update functions with the
+// detection mode, polling source and options picked anew every tick, so that every way of filling the watched tiles is checked,
+// along with the tracked minecarts kept by update_minecart_list.
+
+unsigned int verify_minecart_list() {
+	// compares the tracked minecarts with world->vehicles.all after update_minecart_list, which must have tracked each vehicle,
+	// in order, with its current minecart item; returns the number of records that differ
+	unsigned int mismatches = 0;
+	if (minecarts.size() != world->vehicles.all.size()) {
+		PLUGIN_LOG(LEVEL_ERROR, CATEGORY_VERIFY, "verify: {} minecarts tracked, but {} vehicles", minecarts.size(), world->vehicles.all.size());
+		++mismatches;
+	}
+	for (size_t i = 0; i != minecarts.size() && i != world->vehicles.all.size(); ++i) {
+		const minecart_info& info = minecarts[i];
+		df::vehicle* minecart = world->vehicles.all[i];
+		if (info.id != minecart->id || info.minecart != minecart || info.minecart_item.get_id() != minecart->item_id) {
+			PLUGIN_LOG(LEVEL_ERROR, CATEGORY_VERIFY, "verify: minecart {} tracked where vehicle {} is", info.id, minecart->id);
+			++mismatches;
+		}
+	}
+	return mismatches;
+}
+
+struct fuzz_settings {
+	// the settings that choose how the watched tiles are filled, which the fuzzer picks anew every tick
+	detection_mode_t detection_mode;
+	scan_source_t scan_source;
+	unsigned int sweep_interval;
+	bool occupancy_prefilter;
+	bool block_tracking;
+	unsigned int snapshot_refresh;
+	size_t scan_chunk_size;
+	unsigned int lookahead_ticks;
+	unsigned int sleep_after;
+	bool pipelining;
+};
+
+fuzz_settings get_fuzz_settings() {
+	// returns the current settings
+	return fuzz_settings{
+		detection_mode, scan_source, sweep_interval, occupancy_prefilter, block_tracking, snapshot_refresh, scan_chunk_size,
+		lookahead_ticks, sleep_after, pipelining
+	};
+}
+
+void set_fuzz_settings(const fuzz_settings& settings) {
+	// makes <settings> the current settings
+	if (settings.detection_mode != detection_mode) {
+		set_detection_mode(settings.detection_mode);
+	}
+	scan_source = settings.scan_source;
+	sweep_interval = settings.sweep_interval;
+	occupancy_prefilter = settings.occupancy_prefilter;
+	block_tracking = settings.block_tracking;
+	snapshot_refresh = settings.snapshot_refresh;
+	scan_chunk_size = settings.scan_chunk_size;
+	lookahead_ticks = settings.lookahead_ticks;
+	sleep_after = settings.sleep_after;
+	// the planner thread is left as it is; while it is stopped, a plan is made as soon as it is posted
+	pipelining = settings.pipelining;
+}
+
+// FUZZ_MINECART_CAPACITY: the capacity of the fuzzer's minecarts; loading is not fuzzed, so only the fuzzer puts items in them
+const int32_t FUZZ_MINECART_CAPACITY = 3;
+
+struct fuzz_world {
+	// a synthetic world, mutated at random each tick by mutate_fuzz_world
+	fuzz_world();
+	
+	synthetic_world synthetic;
+	// items, units, minecarts: the objects of synthetic, in no particular order
+	std::vector<df::item*> items;
+	std::vector<df::unit*> units;
+	std::vector<df::vehicle*> minecarts;
+};
+
+fuzz_world::fuzz_world()
+  : synthetic(FUZZ_MINECART_CAPACITY)
+{}
+
+void mutate_fuzz_world(fuzz_world& fuzz, std::mt19937& rng) {
+	// moves, spawns and destroys a few of the items, units and minecarts of <fuzz>, putting some in the air, some on the ground,
+	// some in the units' inventories and some in the minecarts
+	auto uniform = [&rng](int32_t low, int32_t high) {
+		return std::uniform_int_distribution<int32_t>(low, high)(rng);
+	};
+	// random_pos: most objects are put right above some minecart, so that tiles are often hit; all are kept on the map
+	auto random_pos = [&]() {
+		df::coord pos(uniform(0, SYNTHETIC_MAP_TILES - 1), uniform(0, SYNTHETIC_MAP_TILES - 1), uniform(0, SYNTHETIC_MAP_LEVELS - 1));
+		if (!fuzz.minecarts.empty() && uniform(0, 3) != 0) {
+			df::item* minecart_item = get_minecart_item(fuzz.minecarts[uniform(0, int32_t(fuzz.minecarts.size()) - 1)]);
+			pos = minecart_item->pos + df::coord(uniform(-3, 3), uniform(-1, 1), uniform(0, 2));
+		}
+		return pos;
+	};
+	
+	// as in DF, an item on the ground only moves by being knocked into the air, picked up by a unit or put in a minecart, and is
+	// not back on the ground before the next tick
+	// lifted: ids of the items taken off the ground this tick; an item may be destroyed after being lifted, and another made at
+	// its address, so they are told apart by id
+	std::vector<int32_t> lifted;
+	auto was_lifted = [&lifted](df::item* item) {
+		return std::find(lifted.begin(), lifted.end(), item->id) != lifted.end();
+	};
+	for (int32_t op = uniform(0, 8); op != 0; --op) {
+		int32_t action = uniform(0, 5);
+		if (action == 0 || fuzz.items.empty()) {
+			fuzz.items.push_back(fuzz.synthetic.add_item(random_pos(), uniform(0, 1) == 0));
+			continue;
+		}
+		size_t index = size_t(uniform(0, int32_t(fuzz.items.size()) - 1));
+		df::item* item = fuzz.items[index];
+		if (action == 1) {
+			fuzz.synthetic.remove_item(item);
+			fuzz.items[index] = fuzz.items.back();
+			fuzz.items.pop_back();
+		} else if (item->flags.bits.on_ground) {
+			if (action == 4 && !fuzz.units.empty()) {
+				fuzz.synthetic.hold_item(fuzz.units[uniform(0, int32_t(fuzz.units.size()) - 1)], item);
+			} else if (action == 5 && !fuzz.minecarts.empty()) {
+				fuzz.synthetic.put_item_in(get_minecart_item(fuzz.minecarts[uniform(0, int32_t(fuzz.minecarts.size()) - 1)]), item);
+			} else {
+				fuzz.synthetic.move_item(item, random_pos(), true);
+			}
+			lifted.push_back(item->id);
+		} else if (item->flags.bits.in_inventory) {
+			// put down or tipped out where its holder is
+			if (!was_lifted(item)) {
+				fuzz.synthetic.move_item(item, Items::getPosition(item), uniform(0, 1) == 0);
+			}
+		} else {
+			bool landed = uniform(0, 1) == 0 && !was_lifted(item);
+			fuzz.synthetic.move_item(item, random_pos(), !landed);
+		}
+	}
+	for (int32_t op = uniform(0, 8); op != 0; --op) {
+		int32_t action = uniform(0, 3);
+		if (action == 0 || fuzz.units.empty()) {
+			fuzz.units.push_back(fuzz.synthetic.add_unit(random_pos(), uniform(0, 1) == 0));
+			continue;
+		}
+		size_t index = size_t(uniform(0, int32_t(fuzz.units.size()) - 1));
+		df::unit* unit = fuzz.units[index];
+		if (action == 1) {
+			// a unit dropping what it has just picked up would put it back on the ground this tick
+			if (std::any_of(unit->inventory.begin(), unit->inventory.end(), [&](df::unit_inventory_item* held) {
+				return was_lifted(held->item);
+			})) {
+				continue;
+			}
+			fuzz.synthetic.remove_unit(unit);
+			fuzz.units[index] = fuzz.units.back();
+			fuzz.units.pop_back();
+		} else {
+			fuzz.synthetic.move_unit(unit, random_pos(), uniform(0, 1) == 0);
+		}
+	}
+	
+	for (int32_t op = uniform(0, 3); op != 0; --op) {
+		int32_t action = uniform(0, 5);
+		if (action == 0 || fuzz.minecarts.empty()) {
+			df::coord pos(
+				uniform(8, SYNTHETIC_MAP_TILES - 9),
+				uniform(8, SYNTHETIC_MAP_TILES - 9),
+				uniform(0, SYNTHETIC_MAP_LEVELS - 3)
+			);
+			fuzz.minecarts.push_back(fuzz.synthetic.add_minecart(pos));
+			continue;
+		}
+		size_t index = size_t(uniform(0, int32_t(fuzz.minecarts.size()) - 1));
+		df::vehicle* minecart = fuzz.minecarts[index];
+		switch (action) {
+			case 1: {
+				// as for units, a minecart's contents are dropped with it
+				std::vector<df::item*> contents;
+				Items::getContainedItems(get_minecart_item(minecart), &contents);
+				if (std::any_of(contents.begin(), contents.end(), was_lifted)) {
+					break;
+				}
+				fuzz.synthetic.remove_minecart(minecart);
+				fuzz.minecarts[index] = fuzz.minecarts.back();
+				fuzz.minecarts.pop_back();
+				break;
+			}
+			case 2:
+				// a third of the minecarts are left stationary, so that they fall asleep
+				if (uniform(0, 2) == 0) {
+					minecart->speed_x = 0;
+					minecart->speed_y = 0;
+					minecart->speed_z = 0;
+				} else {
+					minecart->speed_x = uniform(-60000, 60000);
+					minecart->speed_y = uniform(-60000, 60000);
+					minecart->speed_z = uniform(-1, 0) * uniform(0, 60000);
+				}
+				break;
+			case 3:
+				minecart->offset_x = uniform(-49999, 49999);
+				minecart->offset_y = uniform(-49999, 49999);
+				break;
+			case 4: {
+				// loading is not fuzzed, but the filters of the awake minecarts decide what the watched tiles record
+				// the fuzzer's items are all boulders
+				static const char* const FILTERS[] = {"no-items", "no-units", "type=BOULDER", "type=WOOD", "type!=BOULDER units"};
+				if (uniform(0, 3) == 0) {
+					cart_filters.erase(minecart->id);
+				} else {
+					std::string error;
+					compile_filter(FILTERS[uniform(0, 4)], cart_filters[minecart->id], error);
+				}
+				++filters_generation;
+				break;
+			}
+			default: {
+				df::item* minecart_item = get_minecart_item(minecart);
+				df::coord pos = minecart_item->pos + df::coord(uniform(-1, 1), uniform(-1, 1), 0);
+				pos.x = std::min(std::max(pos.x, int16_t(8)), int16_t(SYNTHETIC_MAP_TILES - 9));
+				pos.y = std::min(std::max(pos.y, int16_t(8)), int16_t(SYNTHETIC_MAP_TILES - 9));
+				fuzz.synthetic.move_item(minecart_item, pos, false);
+				break;
+			}
+		}
+	}
+}
+
+fuzz_settings random_fuzz_settings(std::mt19937& rng) {
+	// returns settings chosen at random among every way of filling the watched tiles
+	auto uniform = [&rng](int32_t low, int32_t high) {
+		return std::uniform_int_distribution<int32_t>(low, high)(rng);
+	};
+	fuzz_settings settings;
+	settings.detection_mode = uniform(0, 3) == 0 ? DETECTION_EVENTS : DETECTION_POLLING;
+	settings.scan_source = uniform(0, 1) == 0 ? SCAN_ALL : SCAN_PROJECTILES;
+	settings.sweep_interval = unsigned(uniform(0, 1) * uniform(1, 4));
+	settings.occupancy_prefilter = uniform(0, 1) == 0;
+	settings.block_tracking = uniform(0, 2) == 0;
+	settings.snapshot_refresh = unsigned(uniform(0, 1) * uniform(1, 8));
+	// a chunk of a few objects, so that the parallel scans split the fuzzer's small world
+	settings.scan_chunk_size = uniform(0, 1) == 0 ? SCAN_CHUNK_SIZE : SNAPSHOT_LANES * size_t(uniform(1, 2));
+	settings.lookahead_ticks = unsigned(uniform(1, 4));
+	settings.sleep_after = unsigned(uniform(0, 3));
+	settings.pipelining = uniform(0, 1) == 0;
+	return settings;
+}
+
+unsigned int run_fuzz_tick(fuzz_world& fuzz, std::mt19937& rng) {
+	// runs one tick of <fuzz>, under settings chosen at random, through the real update_minecart_list and update_minecart_info
+	// with verify on; returns the number of tracked minecarts and watched tiles that differ from the reference
+	// loading is left out, so that the objects stay where mutate_fuzz_world put them
+	fuzz_settings settings = random_fuzz_settings(rng);
+	set_fuzz_settings(settings);
+	fuzz.synthetic.advance_tick();
+	mutate_fuzz_world(fuzz, rng);
+	// as the game moves every projectile every tick, through the interposes while they are installed
+	if (detection_mode == DETECTION_EVENTS) {
+		note_objects_in_air();
+	}
+	
+	uint64_t mismatches_before = stats.counters[COUNTER_VERIFY_MISMATCHES];
+	invalidate_projectile_index();
+	refresh_handle_epochs();
+	update_minecart_list();
+	unsigned int mismatches = verify_minecart_list();
+	update_minecart_info();
+	mismatches += (unsigned int)(stats.counters[COUNTER_VERIFY_MISMATCHES] - mismatches_before);
+	if (mismatches != 0) {
+		PLUGIN_LOG(LEVEL_ERROR, CATEGORY_VERIFY, "verify fuzz: under mode {}, source {}, sweep interval {}, prefilter {}",
+			int(settings.detection_mode), int(settings.scan_source), settings.sweep_interval, int(settings.occupancy_prefilter));
+		PLUGIN_LOG(LEVEL_ERROR, CATEGORY_VERIFY, "verify fuzz: and block tracking {}, snapshot refresh {}, chunk size {}, lookahead {}",
+			int(settings.block_tracking), settings.snapshot_refresh, settings.scan_chunk_size, settings.lookahead_ticks);
+		PLUGIN_LOG(LEVEL_ERROR, CATEGORY_VERIFY, "verify fuzz: and pipelining {}", int(settings.pipelining));
+	}
+	return mismatches;
+}
+
+
+command_result fuzz_command(color_ostream& out, std::vector<std::string>& parameters) {
+	// subcommand "fuzz [ticks <n>] [seed <n>]": runs the fuzzer, by default for 10000 ticks
+	unsigned int ticks = 10000;
+	unsigned int seed = 1;
+	for (size_t i = 1; i != parameters.size(); i += 2) {
+		unsigned int value;
+		if (i + 1 == parameters.size() || !parse_uint(parameters[i + 1], value)) {
+			return CR_WRONG_USAGE;
+		}
+		if (parameters[i] == "ticks") {
+			ticks = value;
+		} else if (parameters[i] == "seed") {
+			seed = value;
+		} else {
+			return CR_WRONG_USAGE;
+		}
+	}
+	
+	// the planner thread is stopped, so that the plans are made on this thread, and the scans are split between two threads
+	set_pipelining(false);
+	verify_enabled = true;
+	scan_pool.resize(2);
+	
+	std::mt19937 rng(seed);
+	fuzz_world fuzz;
+	// failed_ticks: ticks with at least one mismatch
+	unsigned int failed_ticks = 0;
+	for (unsigned int tick = 0; tick != ticks; ++tick) {
+		if (run_fuzz_tick(fuzz, rng) != 0) {
+			if (failed_ticks == 0) {
+				out.printerr("fuzz: first mismatch at tick %u; see the log for details\n", tick);
+			}
+			++failed_ticks;
+		}
+	}
+	out.print("fuzz: seed %u, %u ticks, %u with mismatches; ended with %zu minecarts, %zu items, %zu units\n",
+		seed, ticks, failed_ticks, fuzz.minecarts.size(), fuzz.items.size(), fuzz.units.size()
+	);
+	return failed_ticks == 0 ? CR_OK : CR_FAILURE;
+}
+
+
+
+// Steady state
+// Once a world has settled, an update should neither grow the plugin's buffers nor allocate at all, apart from committing loads:
+// that allocates in DF itself, through Items::moveToContainer and the MapCache, so there only the buffers are checked. The steady
+// subcommand checks both on the stage benchmark's world, under each way of filling the watched tiles, counting every heap
+// allocation of every thread through a replaced operator new. The stand-in MapCache allocates nothing, where DFHack's allocates
+// its blocks on every update that loads.
+
+// heap_allocations: allocations made through operator new, by any thread, since the program started
+std::atomic<uint64_t> heap_allocations(0);
+
+void* operator new(size_t size) {
+	++heap_allocations;
+	if (void* ptr = std::malloc(size != 0 ? size : 1)) {
+		return ptr;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+	std::free(ptr);
+}
+
+// STEADY_WARM_UP_ROUNDS, STEADY_ROUNDS: the updates run before counting, and those counted
+const unsigned int STEADY_WARM_UP_ROUNDS = 100;
+const unsigned int STEADY_ROUNDS = 200;
+
+struct steady_result {
+	// growths: buffer growths made by the counted updates
+	uint64_t growths;
+	// allocations: heap allocations made by the counted updates, outside of perform_minecart_loading
+	uint64_t allocations;
+	uint64_t loaded;
+};
+
+steady_result run_steady(const bench_config& config, const bench_world& bench) {
+	// runs the update stages on the stage benchmark's world made from <bench>, under the current settings, counting the buffer
+	// growths and allocations of the rounds after the warm-up; a plan made in the background is waited for within its update
+	steady_result result = {};
+	unsigned int round = 0;
+	auto count_stage = [&](bench_kernel_t kernel, const std::function<void()>& stage) {
+		if (kernel == BENCH_MINECART_LIST) {
+			++round;
+			// as the game moves every projectile every tick, through the interposes while they are installed
+			if (detection_mode == DETECTION_EVENTS) {
+				note_objects_in_air();
+			}
+		}
+		uint64_t growths_before = buffer_growths;
+		uint64_t allocations_before = heap_allocations;
+		stage();
+		finish_plan();
+		if (round > STEADY_WARM_UP_ROUNDS) {
+			result.growths += buffer_growths - growths_before;
+			if (kernel != BENCH_MINECART_LOADING) {
+				result.allocations += heap_allocations - allocations_before;
+			}
+		}
+	};
+	result.loaded = run_stage_bench(config, bench, count_stage);
+	return result;
+}
+
+command_result steady_command(color_ostream& out, std::vector<std::string>& parameters) {
+	// subcommand "steady": checks that settled updates neither grow the plugin's buffers nor allocate, under each way of filling
+	// the watched tiles
+	if (parameters.size() != 1) {
+		return CR_WRONG_USAGE;
+	}
+	
+	// cases: the ways of filling the watched tiles, each from the defaults but for the settings named; the scans are split between
+	// two threads wherever there are enough objects to split
+	fuzz_settings defaults = get_fuzz_settings();
+	std::vector<std::pair<const char*, fuzz_settings>> cases;
+	fuzz_settings settings = defaults;
+	cases.push_back(std::make_pair("projectiles", settings));
+	settings.scan_source = SCAN_ALL;
+	cases.push_back(std::make_pair("all", settings));
+	settings.scan_chunk_size = SNAPSHOT_LANES * 64;
+	cases.push_back(std::make_pair("all_parallel", settings));
+	settings.snapshot_refresh = 1;
+	cases.push_back(std::make_pair("snapshot_parallel", settings));
+	settings.snapshot_refresh = 0;
+	settings.block_tracking = true;
+	cases.push_back(std::make_pair("blocks", settings));
+	settings = defaults;
+	settings.detection_mode = DETECTION_EVENTS;
+	cases.push_back(std::make_pair("events", settings));
+	settings = defaults;
+	settings.pipelining = true;
+	cases.push_back(std::make_pair("pipelined", settings));
+	
+	bench_config config = {10000, 100, 10, 10, STEADY_WARM_UP_ROUNDS + STEADY_ROUNDS};
+	bench_world bench;
+	make_bench_world(config, config.item_count, bench);
+	scan_pool.resize(2);
+	bool steady = true;
+	for (const auto& entry : cases) {
+		set_fuzz_settings(entry.second);
+		set_pipelining(entry.second.pipelining);
+		steady_result result = run_steady(config, bench);
+		out.print("steady %s: %u updates after %u: %llu buffer growths, %llu allocations; %llu loaded\n",
+			entry.first, STEADY_ROUNDS, STEADY_WARM_UP_ROUNDS,
+			(unsigned long long)result.growths, (unsigned long long)result.allocations, (unsigned long long)result.loaded
+		);
+		steady = steady && result.growths == 0 && result.allocations == 0;
+	}
+	set_fuzz_settings(defaults);
+	set_pipelining(false);
+	return steady ? CR_OK : CR_FAILURE;
+}
+
+
+
+// Main
+
+// offline_world: the stand-in DF world the plugin's world points at
+df::world offline_world;
+
+int main(int argc, char** argv) {
+	// runs the subcommand named by the arguments; returns 0 if it succeeded
+	world = &offline_world;
+	color_ostream out;
+	std::vector<std::string> parameters(argv + 1, argv + argc);
+	command_result result = CR_WRONG_USAGE;
+	if (!parameters.empty() && parameters[0] == "bench") {
+		result = bench_command(out, parameters);
+	} else if (!parameters.empty() && parameters[0] == "fuzz") {
+		result = fuzz_command(out, parameters);
+	} else if (!parameters.empty() && parameters[0] == "steady") {
+		result = steady_command(out, parameters);
+	}
+	
+	if (result == CR_WRONG_USAGE) {
+		out.printerr(
+			"usage: minecart_fall_loading_offline <subcommand>\n"
+			"  bench [items <n>]... [carts <n>] [shafts <n>] [projectiles <permille>] [rounds <n>]\n"
+			"    Benchmark the scan paths and the update stages on synthetic worlds, by default of 10000, 100000 and 1000000 items.\n"
+			"  fuzz [ticks <n>] [seed <n>]\n"
+			"    Check the tracked minecarts and watched tiles against the verify reference over random synthetic worlds,\n"
+			"    filling the tiles every way there is (default 10000 ticks).\n"
+			"  steady\n"
+			"    Check that, once settled, updates neither grow the plugin's buffers nor allocate, under each way of filling the\n"
+			"    watched tiles.\n"
+		);
+	}
+	set_pipelining(false);
+	scan_pool.resize(0);
+	return result == CR_OK ? 0 : 1;
+}
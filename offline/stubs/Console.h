@@ -0,0 +1,4 @@
+// Stand-in for DFHack's Console.h; color_ostream is declared in Core.h
+#pragma once
+
+#include "Core.h"
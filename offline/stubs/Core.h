@@ -0,0 +1,44 @@
+// Stand-in for DFHack's Core.h, declaring only what minecart_fall_loading uses; see offline/CMakeLists.txt
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace DFHack {
+	class color_ostream {
+		// prints to stdout, and errors to stderr
+		public:
+			void print(const char* format, ...);
+			void printerr(const char* format, ...);
+	};
+
+	enum command_result {
+		CR_LINK_FAILURE = -3,
+		CR_NEEDS_CONSOLE = -2,
+		CR_NOT_IMPLEMENTED = -1,
+		CR_OK = 0,
+		CR_FAILURE = 1,
+		CR_WRONG_USAGE = 2,
+		CR_NOT_FOUND = 3
+	};
+
+	enum state_change_event {
+		SC_UNKNOWN = -1,
+		SC_WORLD_LOADED = 0,
+		SC_WORLD_UNLOADED = 1,
+		SC_MAP_LOADED = 2,
+		SC_MAP_UNLOADED = 3,
+		SC_VIEWSCREEN_CHANGED = 4,
+		SC_CORE_INITIALIZED = 5,
+		SC_BEGIN_UNLOAD = 6,
+		SC_PAUSED = 7,
+		SC_UNPAUSED = 8
+	};
+
+	class CoreSuspender {
+		// there is no game thread offline, so this does nothing
+		public:
+			CoreSuspender() {}
+	};
+}
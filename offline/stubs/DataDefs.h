@@ -0,0 +1,21 @@
+// Stand-in for DFHack's DataDefs.h: the enum support the stand-in df headers use
+#pragma once
+
+#include <string>
+
+namespace df {
+	namespace enums {}
+
+	template<class T>
+	struct enum_traits;
+}
+
+using namespace df::enums;
+
+#define ENUM_LAST_ITEM(enum) (df::enum_traits<df::enum>::last_item_value)
+
+namespace DFHack {
+	// specialised in the stand-in headers of the enums looked up by name
+	template<class T>
+	bool find_enum_item(T* var, const std::string& name);
+}
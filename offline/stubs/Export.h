@@ -0,0 +1,4 @@
+// Stand-in for DFHack's Export.h
+#pragma once
+
+#define DFhackCExport extern "C"
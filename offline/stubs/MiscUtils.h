@@ -0,0 +1,20 @@
+// Stand-in for DFHack's MiscUtils.h
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+template<class T>
+void vector_erase_at(std::vector<T>& vec, size_t index) {
+	if (index < vec.size()) {
+		vec.erase(vec.begin() + index);
+	}
+}
+
+template<class T, class S>
+inline T* virtual_cast(S* ptr) {
+	return dynamic_cast<T*>(ptr);
+}
+
+bool split_string(std::vector<std::string>* out, const std::string& str, const std::string& separator, bool squash_empty = false);
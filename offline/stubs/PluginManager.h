@@ -0,0 +1,38 @@
+// Stand-in for DFHack's PluginManager.h
+#pragma once
+
+#include "Core.h"
+#include "Export.h"
+
+#include <vector>
+#include <string>
+
+namespace df {
+	struct world;
+}
+
+namespace DFHack {
+	typedef command_result (*command_function)(color_ostream& out, std::vector<std::string>& parameters);
+
+	struct PluginCommand {
+		PluginCommand(const char* name, const char* description, command_function function, bool interactive = false,
+			const char* usage = "")
+		  : name(name),
+		    description(description),
+		    function(function),
+		    interactive(interactive),
+		    usage(usage)
+		{}
+
+		std::string name;
+		std::string description;
+		command_function function;
+		bool interactive;
+		std::string usage;
+	};
+}
+
+// the offline target is its own program, so the plugin's globals are plain globals, set by its main
+#define DFHACK_PLUGIN(name)
+#define DFHACK_PLUGIN_IS_ENABLED(name) bool name = false
+#define REQUIRE_GLOBAL(name) df::name* name = nullptr
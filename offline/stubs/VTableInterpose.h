@@ -0,0 +1,27 @@
+// Stand-in for DFHack's VTableInterpose.h: offline, nothing is interposed, and the game's movement is driven by the tests
+#pragma once
+
+namespace DFHack {
+	class VMethodInterposeLinkBase {
+		public:
+			bool apply(bool enable = true) { return applied = enable, true; }
+			void remove() { applied = false; }
+			bool is_applied() const { return applied; }
+		private:
+			bool applied = false;
+	};
+}
+
+#define DEFINE_VMETHOD_INTERPOSE(rtype, name, args) \
+	static DFHack::VMethodInterposeLinkBase& interpose_link_##name(); \
+	rtype interpose_##name args
+
+#define INTERPOSE_NEXT(name) (this->interpose_base::name)
+
+#define IMPLEMENT_VMETHOD_INTERPOSE(class, name) \
+	DFHack::VMethodInterposeLinkBase& class::interpose_link_##name() { \
+		static DFHack::VMethodInterposeLinkBase link; \
+		return link; \
+	}
+
+#define INTERPOSE_HOOK(class, name) (class::interpose_link_##name())
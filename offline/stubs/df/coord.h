@@ -0,0 +1,30 @@
+// Stand-in for df/coord.h
+#pragma once
+
+#include <cstdint>
+
+namespace df {
+	struct coord {
+		int16_t x;
+		int16_t y;
+		int16_t z;
+
+		coord() : x(-30000), y(-30000), z(-30000) {}
+		coord(int16_t x, int16_t y, int16_t z) : x(x), y(y), z(z) {}
+
+		bool isValid() const { return x != -30000; }
+		void clear() { x = y = z = -30000; }
+
+		bool operator==(const coord& other) const { return x == other.x && y == other.y && z == other.z; }
+		bool operator!=(const coord& other) const { return !(*this == other); }
+		bool operator<(const coord& other) const {
+			if (x != other.x) return x < other.x;
+			if (y != other.y) return y < other.y;
+			return z < other.z;
+		}
+		coord operator+(const coord& other) const { return coord(x + other.x, y + other.y, z + other.z); }
+		coord operator-(const coord& other) const { return coord(x - other.x, y - other.y, z - other.z); }
+		coord operator/(int number) const { return coord(x / number, y / number, z / number); }
+		coord operator%(int number) const { return coord(x % number, y % number, z % number); }
+	};
+}
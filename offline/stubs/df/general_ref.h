@@ -0,0 +1,82 @@
+// Stand-in for df/general_ref.h, with df/general_ref_type.h
+#pragma once
+
+#include <cstdint>
+
+#include "DataDefs.h"
+
+namespace df {
+	namespace enums {
+		namespace general_ref_type {
+			enum general_ref_type : int32_t {
+				NONE = -1,
+				ARTIFACT = 0,
+				IS_ARTIFACT = 1,
+				NEMESIS = 2,
+				IS_NEMESIS = 3,
+				ITEM = 4,
+				ITEM_TYPE = 5,
+				COINBATCH = 6,
+				MAPSQUARE = 7,
+				ENTITY_ART_IMAGE = 8,
+				CONTAINS_UNIT = 9,
+				CONTAINS_ITEM = 10,
+				CONTAINED_IN_ITEM = 11,
+				PROJECTILE = 12,
+				UNIT = 13,
+				UNIT_MILKEE = 14,
+				UNIT_TRAINEE = 15,
+				UNIT_ITEMOWNER = 16,
+				UNIT_TRADEBRINGER = 17,
+				UNIT_HOLDER = 18,
+				UNIT_WORKER = 19,
+				UNIT_CAGEE = 20,
+				UNIT_BEATEE = 21,
+				UNIT_FOODRECEIVER = 22,
+				UNIT_KIDNAPEE = 23,
+				UNIT_PATIENT = 24,
+				UNIT_INFANT = 25,
+				UNIT_SLAUGHTEREE = 26,
+				UNIT_SHEAREE = 27,
+				UNIT_SUCKEE = 28,
+				UNIT_REPORTEE = 29,
+				BUILDING = 30,
+				BUILDING_CIVZONE_ASSIGNED = 31,
+				BUILDING_TRIGGER = 32,
+				BUILDING_TRIGGERTARGET = 33,
+				BUILDING_CHAIN = 34,
+				BUILDING_CAGED = 35,
+				BUILDING_HOLDER = 36,
+				BUILDING_WELL_TAG = 37,
+				BUILDING_USE_TARGET_1 = 38,
+				BUILDING_USE_TARGET_2 = 39,
+				BUILDING_DESTINATION = 40,
+				BUILDING_NEST_BOX = 41,
+				ENTITY = 42,
+				ENTITY_STOLEN = 43,
+				ENTITY_OFFERED = 44,
+				ENTITY_ITEMOWNER = 45,
+				LOCATION = 46,
+				INTERACTION = 47,
+				ABSTRACT_BUILDING = 48,
+				HISTORICAL_EVENT = 49,
+				SPHERE = 50,
+				SITE = 51,
+				SUBREGION = 52,
+				FEATURE_LAYER = 53,
+				HISTORICAL_FIGURE = 54,
+				ENTITY_POP = 55,
+				CREATURE = 56,
+				UNIT_RIDER = 57,
+				UNIT_CLIMBER = 58,
+				UNIT_GELDEE = 59
+			};
+		}
+	}
+	using df::enums::general_ref_type::general_ref_type;
+
+	struct general_ref {
+		virtual ~general_ref() {}
+		virtual df::general_ref_type getType() { return df::general_ref_type::NONE; }
+	};
+}
@@ -0,0 +1,12 @@
+// Stand-in for df/general_ref_contained_in_itemst.h
+#pragma once
+
+#include "df/general_ref.h"
+
+namespace df {
+	struct general_ref_contained_in_itemst : general_ref {
+		int32_t item_id = -1;
+
+		df::general_ref_type getType() override { return df::general_ref_type::CONTAINED_IN_ITEM; }
+	};
+}
@@ -0,0 +1,77 @@
+// Stand-in for df/item.h
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "df/coord.h"
+#include "df/item_type.h"
+#include "df/general_ref.h"
+
+namespace df {
+	union item_flags {
+		uint32_t whole;
+		struct {
+			uint32_t on_ground : 1;
+			uint32_t in_job : 1;
+			uint32_t hostile : 1;
+			uint32_t in_inventory : 1;
+			uint32_t removed : 1;
+			uint32_t in_building : 1;
+			uint32_t container : 1;
+			uint32_t dead_dwarf : 1;
+			uint32_t rotten : 1;
+			uint32_t spider_web : 1;
+			uint32_t construction : 1;
+			uint32_t encased : 1;
+			uint32_t unk12 : 1;
+			uint32_t murder : 1;
+			uint32_t foreign : 1;
+			uint32_t trader : 1;
+			uint32_t owned : 1;
+			uint32_t garbage_collect : 1;
+			uint32_t artifact : 1;
+			uint32_t forbid : 1;
+			uint32_t already_uncategorized : 1;
+			uint32_t dump : 1;
+			uint32_t on_fire : 1;
+			uint32_t melt : 1;
+			uint32_t hidden : 1;
+			uint32_t in_chest : 1;
+			uint32_t use_recorded : 1;
+			uint32_t artifact_mood : 1;
+			uint32_t temps_computed : 1;
+			uint32_t weight_computed : 1;
+			uint32_t unk30 : 1;
+			uint32_t from_worldgen : 1;
+		} bits;
+	};
+
+	union item_flags2 {
+		uint32_t whole;
+		struct {
+			uint32_t has_rider : 1;
+			uint32_t unk1 : 31;
+		} bits;
+	};
+
+	struct item {
+		// owns its general_refs
+		virtual ~item();
+
+		// find: by a binary search of world->items.all, which is kept sorted by id
+		static item* find(int32_t id);
+
+		virtual df::item_type getType() { return df::item_type::NONE; }
+		virtual int16_t getSubtype() { return -1; }
+		virtual int16_t getMaterial() { return 0; }
+		virtual int32_t getMaterialIndex() { return 0; }
+		virtual int32_t getVolume() { return 1; }
+
+		df::coord pos;
+		item_flags flags = {};
+		item_flags2 flags2 = {};
+		int32_t id = -1;
+		std::vector<df::general_ref*> general_refs;
+	};
+}
@@ -0,0 +1,10 @@
+// Stand-in for df/item_boulderst.h
+#pragma once
+
+#include "df/item.h"
+
+namespace df {
+	struct item_boulderst : item {
+		df::item_type getType() override { return df::item_type::BOULDER; }
+	};
+}
@@ -0,0 +1,13 @@
+// Stand-in for df/item_toolst.h
+#pragma once
+
+#include "df/item.h"
+#include "df/itemdef_toolst.h"
+
+namespace df {
+	struct item_toolst : item {
+		df::item_type getType() override { return df::item_type::TOOL; }
+
+		df::itemdef_toolst* subtype = nullptr;
+	};
+}
@@ -0,0 +1,35 @@
+// Stand-in for df/item_type.h: the types the offline target names keep their values, the rest are left out
+#pragma once
+
+#include <cstdint>
+
+#include "DataDefs.h"
+
+namespace df {
+	namespace enums {
+		namespace item_type {
+			enum item_type : int16_t {
+				NONE = -1,
+				BAR = 0,
+				SMALLGEM = 1,
+				BLOCKS = 2,
+				ROUGH = 3,
+				BOULDER = 4,
+				WOOD = 5,
+				TOOL = 85,
+				PLANT_GROWTH = 95
+			};
+		}
+	}
+	using df::enums::item_type::item_type;
+
+	template<>
+	struct enum_traits<df::item_type> {
+		static const df::item_type last_item_value = df::item_type::PLANT_GROWTH;
+	};
+}
+
+namespace DFHack {
+	template<>
+	bool find_enum_item<df::item_type>(df::item_type* var, const std::string& name);
+}
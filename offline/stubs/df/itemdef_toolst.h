@@ -0,0 +1,10 @@
+// Stand-in for df/itemdef_toolst.h
+#pragma once
+
+#include <cstdint>
+
+namespace df {
+	struct itemdef_toolst {
+		int32_t container_capacity = 0;
+	};
+}
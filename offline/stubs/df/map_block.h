@@ -0,0 +1,17 @@
+// Stand-in for df/map_block.h
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "df/coord.h"
+#include "df/tile_occupancy.h"
+
+namespace df {
+	struct map_block {
+		df::coord map_pos;
+		// items: the ids of the items on the ground within the block
+		std::vector<int32_t> items;
+		df::tile_occupancy occupancy[16][16] = {};
+	};
+}
@@ -0,0 +1,14 @@
+// Stand-in for df/proj_itemst.h
+#pragma once
+
+#include "df/projectile.h"
+
+namespace df {
+	struct item;
+
+	struct proj_itemst : projectile {
+		df::projectile_type getType() override { return df::projectile_type::Item; }
+
+		df::item* item = nullptr;
+	};
+}
@@ -0,0 +1,12 @@
+// Stand-in for df/proj_list_link.h
+#pragma once
+
+namespace df {
+	struct projectile;
+
+	struct proj_list_link {
+		df::projectile* item = nullptr;
+		df::proj_list_link* prev = nullptr;
+		df::proj_list_link* next = nullptr;
+	};
+}
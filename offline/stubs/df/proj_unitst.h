@@ -0,0 +1,14 @@
+// Stand-in for df/proj_unitst.h
+#pragma once
+
+#include "df/projectile.h"
+
+namespace df {
+	struct unit;
+
+	struct proj_unitst : projectile {
+		df::projectile_type getType() override { return df::projectile_type::Unit; }
+
+		df::unit* unit = nullptr;
+	};
+}
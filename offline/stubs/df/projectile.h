@@ -0,0 +1,57 @@
+// Stand-in for df/projectile.h
+#pragma once
+
+#include <cstdint>
+
+#include "df/coord.h"
+#include "DataDefs.h"
+
+namespace df {
+	namespace enums {
+		namespace projectile_type {
+			enum projectile_type : int32_t {
+				Item = 0,
+				Unit = 1,
+				Magic = 2
+			};
+		}
+	}
+	using df::enums::projectile_type::projectile_type;
+
+	union projectile_flags {
+		uint32_t whole;
+		struct {
+			uint32_t no_impact_destroy : 1;
+			uint32_t has_hit_ground : 1;
+			uint32_t bouncing : 1;
+			uint32_t high_flying : 1;
+			uint32_t piercing : 1;
+			uint32_t to_be_deleted : 1;
+			uint32_t parabolic : 1;
+			uint32_t unk7 : 25;
+		} bits;
+	};
+
+	struct projectile {
+		virtual ~projectile() {}
+		virtual df::projectile_type getType() = 0;
+		// checkMovement: moves the projectile a tick; offline, projectiles are moved by the tests instead
+		virtual bool checkMovement() { return false; }
+
+		int32_t id = -1;
+		df::coord origin_pos;
+		df::coord target_pos;
+		df::coord cur_pos;
+		df::coord prev_pos;
+		int32_t distance_flown = 0;
+		projectile_flags flags = {};
+		int16_t fall_counter = 0;
+		int16_t fall_delay = 0;
+		int32_t speed_x = 0;
+		int32_t speed_y = 0;
+		int32_t speed_z = 0;
+		int32_t accel_x = 0;
+		int32_t accel_y = 0;
+		int32_t accel_z = 0;
+	};
+}
@@ -0,0 +1,35 @@
+// Stand-in for df/tile_occupancy.h
+#pragma once
+
+#include <cstdint>
+
+#include "DataDefs.h"
+
+namespace df {
+	namespace enums {
+		namespace tile_building_occ {
+			enum tile_building_occ : uint32_t {
+				None = 0,
+				Planned = 1,
+				Passable = 2,
+				Obstacle = 3,
+				Well = 4,
+				Floored = 5,
+				Impassable = 6,
+				Dynamic = 7
+			};
+		}
+	}
+	using df::enums::tile_building_occ::tile_building_occ;
+
+	union tile_occupancy {
+		uint32_t whole;
+		struct {
+			df::tile_building_occ building : 3;
+			uint32_t unit : 1;
+			uint32_t unit_grounded : 1;
+			uint32_t item : 1;
+			uint32_t unk6 : 26;
+		} bits;
+	};
+}
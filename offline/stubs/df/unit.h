@@ -0,0 +1,46 @@
+// Stand-in for df/unit.h
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "df/coord.h"
+#include "df/unit_inventory_item.h"
+
+namespace df {
+	union unit_flags1 {
+		uint32_t whole;
+		struct {
+			uint32_t move_state : 1;
+			uint32_t inactive : 1;
+			uint32_t has_mood : 1;
+			uint32_t had_mood : 1;
+			uint32_t marauder : 1;
+			uint32_t drowning : 1;
+			uint32_t merchant : 1;
+			uint32_t forest : 1;
+			uint32_t left : 1;
+			uint32_t rider : 1;
+			uint32_t incoming : 1;
+			uint32_t diplomat : 1;
+			uint32_t zombie : 1;
+			uint32_t skeleton : 1;
+			uint32_t can_swap : 1;
+			uint32_t on_ground : 1;
+			uint32_t projectile : 1;
+			uint32_t unk17 : 15;
+		} bits;
+	};
+
+	struct unit {
+		// find: by a binary search of world->units.all, which is kept sorted by id
+		static unit* find(int32_t id);
+
+		df::coord pos;
+		int32_t id = -1;
+		unit_flags1 flags1 = {};
+		std::vector<df::unit_inventory_item*> inventory;
+		int16_t mount_type = -1;
+		int32_t riding_item_id = -1;
+	};
+}
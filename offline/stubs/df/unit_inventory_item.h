@@ -0,0 +1,28 @@
+// Stand-in for df/unit_inventory_item.h
+#pragma once
+
+#include <cstdint>
+
+namespace df {
+	struct item;
+
+	struct unit_inventory_item {
+		enum T_mode : int16_t {
+			Hauled = 0,
+			Weapon = 1,
+			Worn = 2,
+			Piercing = 3,
+			Flask = 4,
+			WrappedAround = 5,
+			StuckIn = 6,
+			InMouth = 7,
+			Pet = 8,
+			SewnInto = 9,
+			Strapped = 10
+		};
+
+		df::item* item = nullptr;
+		T_mode mode = Hauled;
+		int16_t body_part_id = -1;
+	};
+}
@@ -0,0 +1,20 @@
+// Stand-in for df/vehicle.h
+#pragma once
+
+#include <cstdint>
+
+namespace df {
+	struct vehicle {
+		typedef int32_t key_field_type;
+
+		int32_t id = -1;
+		int32_t item_id = -1;
+		int32_t offset_x = 0;
+		int32_t offset_y = 0;
+		int32_t offset_z = 0;
+		int32_t speed_x = 0;
+		int32_t speed_y = 0;
+		int32_t speed_z = 0;
+		int32_t route_id = -1;
+	};
+}
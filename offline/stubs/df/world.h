@@ -0,0 +1,40 @@
+// Stand-in for df/world.h
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "df/item.h"
+#include "df/unit.h"
+#include "df/vehicle.h"
+#include "df/map_block.h"
+#include "df/proj_list_link.h"
+
+namespace df {
+	template<class T>
+	T* allocate() {
+		return new T();
+	}
+
+	struct world {
+		struct {
+			std::vector<df::item*> all;
+		} items;
+		struct {
+			std::vector<df::unit*> all;
+			std::vector<df::unit*> active;
+		} units;
+		struct {
+			std::vector<df::vehicle*> all;
+		} vehicles;
+		// proj_list: the head of the list of projectiles, which holds none itself
+		df::proj_list_link proj_list;
+		struct {
+			df::map_block**** block_index = nullptr;
+			int32_t x_count_block = 0;
+			int32_t y_count_block = 0;
+			int32_t z_count_block = 0;
+		} map;
+		int32_t frame_counter = 0;
+	};
+}
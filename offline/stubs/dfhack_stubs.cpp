@@ -0,0 +1,228 @@
+// Definitions behind the stand-in DFHack headers, over the stand-in df::world set up by the offline target
+
+#include "Core.h"
+#include "DataDefs.h"
+#include "MiscUtils.h"
+
+#include "df/world.h"
+#include "df/general_ref_contains_itemst.h"
+#include "df/general_ref_contained_in_itemst.h"
+#include "df/general_ref_unit_holderst.h"
+
+#include "modules/MapCache.h"
+#include "modules/Items.h"
+#include "modules/Units.h"
+#include "modules/Materials.h"
+#include "modules/World.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <map>
+
+using namespace DFHack;
+
+// world: the plugin's, which the offline target points at its own stand-in world
+extern df::world* world;
+
+void color_ostream::print(const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	vfprintf(stdout, format, args);
+	va_end(args);
+}
+
+void color_ostream::printerr(const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+}
+
+bool split_string(std::vector<std::string>* out, const std::string& str, const std::string& separator, bool squash_empty) {
+	out->clear();
+	size_t start = 0;
+	for (;;) {
+		size_t end = str.find(separator, start);
+		std::string part = str.substr(start, end == std::string::npos ? std::string::npos : end - start);
+		if (!squash_empty || !part.empty()) {
+			out->push_back(part);
+		}
+		if (end == std::string::npos) {
+			return true;
+		}
+		start = end + separator.size();
+	}
+}
+
+template<>
+bool DFHack::find_enum_item<df::item_type>(df::item_type* var, const std::string& name) {
+	static const std::map<std::string, df::item_type> TYPES = {
+		{"BAR", df::item_type::BAR},
+		{"SMALLGEM", df::item_type::SMALLGEM},
+		{"BLOCKS", df::item_type::BLOCKS},
+		{"ROUGH", df::item_type::ROUGH},
+		{"BOULDER", df::item_type::BOULDER},
+		{"WOOD", df::item_type::WOOD},
+		{"TOOL", df::item_type::TOOL},
+		{"PLANT_GROWTH", df::item_type::PLANT_GROWTH}
+	};
+	auto iter = TYPES.find(name);
+	if (iter == TYPES.end()) {
+		return false;
+	}
+	*var = iter->second;
+	return true;
+}
+
+bool MaterialInfo::find(const std::string& token) {
+	if (token == "INORGANIC:GRANITE") {
+		type = 0;
+		index = 3;
+		return true;
+	}
+	return false;
+}
+
+
+
+// Objects
+
+template<class T>
+T* find_by_id(const std::vector<T*>& objects, int32_t id) {
+	// returns the object of <objects>, which is sorted by id, with id <id>, or nullptr if there is none
+	auto iter = std::lower_bound(objects.begin(), objects.end(), id, [](const T* object, int32_t id) {
+		return object->id < id;
+	});
+	return iter != objects.end() && (*iter)->id == id ? *iter : nullptr;
+}
+
+df::item::~item() {
+	for (df::general_ref* ref : general_refs) {
+		delete ref;
+	}
+}
+
+df::item* df::item::find(int32_t id) {
+	return find_by_id(::world->items.all, id);
+}
+
+df::unit* df::unit::find(int32_t id) {
+	return find_by_id(::world->units.all, id);
+}
+
+df::coord Items::getPosition(df::item* item) {
+	if (item->flags.bits.in_inventory) {
+		for (df::general_ref* ref : item->general_refs) {
+			switch (ref->getType()) {
+				case df::general_ref_type::CONTAINED_IN_ITEM:
+					return getPosition(df::item::find(((df::general_ref_contained_in_itemst*)ref)->item_id));
+				case df::general_ref_type::UNIT_HOLDER:
+					return df::unit::find(((df::general_ref_unit_holderst*)ref)->unit_id)->pos;
+				default:
+					break;
+			}
+		}
+	}
+	return item->pos;
+}
+
+bool Items::getContainedItems(df::item* item, std::vector<df::item*>* items) {
+	items->clear();
+	for (df::general_ref* ref : item->general_refs) {
+		if (ref->getType() == df::general_ref_type::CONTAINS_ITEM) {
+			items->push_back(df::item::find(((df::general_ref_contains_itemst*)ref)->item_id));
+		}
+	}
+	return true;
+}
+
+bool Items::moveToContainer(MapExtras::MapCache& mc, df::item* item, df::item* container) {
+	if (!item->flags.bits.on_ground || !mc.removeItemOnGround(item)) {
+		return false;
+	}
+	item->flags.bits.on_ground = false;
+	item->flags.bits.in_inventory = true;
+	auto contained_in = df::allocate<df::general_ref_contained_in_itemst>();
+	contained_in->item_id = container->id;
+	item->general_refs.push_back(contained_in);
+	auto contains = df::allocate<df::general_ref_contains_itemst>();
+	contains->item_id = item->id;
+	container->general_refs.push_back(contains);
+	return true;
+}
+
+df::coord Units::getPosition(df::unit* unit) {
+	return unit->pos;
+}
+
+
+
+// Map
+
+df::map_block* get_block_at(df::coord pos) {
+	// returns the map_block holding coord <pos>, or nullptr if there is none
+	const auto& map = world->map;
+	if (map.block_index == nullptr || pos.x < 0 || pos.y < 0 || pos.z < 0
+		|| pos.x / 16 >= map.x_count_block || pos.y / 16 >= map.y_count_block || pos.z >= map.z_count_block
+	) {
+		return nullptr;
+	}
+	return map.block_index[pos.x / 16][pos.y / 16][pos.z];
+}
+
+bool MapExtras::MapCache::addItemOnGround(df::item* item) {
+	df::map_block* block = get_block_at(item->pos);
+	if (block == nullptr) {
+		return false;
+	}
+	block->items.push_back(item->id);
+	block->occupancy[item->pos.x % 16][item->pos.y % 16].bits.item = true;
+	return true;
+}
+
+bool MapExtras::MapCache::removeItemOnGround(df::item* item) {
+	df::map_block* block = get_block_at(item->pos);
+	if (block == nullptr) {
+		return true;
+	}
+	auto iter = std::find(block->items.begin(), block->items.end(), item->id);
+	if (iter == block->items.end()) {
+		return false;
+	}
+	block->items.erase(iter);
+	df::coord pos = item->pos;
+	block->occupancy[pos.x % 16][pos.y % 16].bits.item = std::any_of(block->items.begin(), block->items.end(), [pos](int32_t id) {
+		return df::item::find(id)->pos == pos;
+	});
+	return true;
+}
+
+
+
+// Persistent data
+
+// persistent_data: by key
+std::map<std::string, std::string> persistent_data;
+
+PersistentDataItem World::GetPersistentData(const std::string& key) {
+	auto iter = persistent_data.find(key);
+	return iter != persistent_data.end() ? PersistentDataItem(key, &iter->second) : PersistentDataItem();
+}
+
+PersistentDataItem World::AddPersistentData(const std::string& key) {
+	return PersistentDataItem(key, &persistent_data[key]);
+}
+
+void World::GetPersistentData(std::vector<PersistentDataItem>* vec, const std::string& key, bool prefix) {
+	vec->clear();
+	for (auto& entry : persistent_data) {
+		if (prefix ? entry.first.compare(0, key.size(), key) == 0 : entry.first == key) {
+			vec->push_back(PersistentDataItem(entry.first, &entry.second));
+		}
+	}
+}
+
+bool World::DeletePersistentData(const PersistentDataItem& item) {
+	return persistent_data.erase(item.key()) != 0;
+}
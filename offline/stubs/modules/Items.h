@@ -0,0 +1,18 @@
+// Stand-in for modules/Items.h
+#pragma once
+
+#include <vector>
+
+#include "df/coord.h"
+#include "df/item.h"
+#include "modules/MapCache.h"
+
+namespace DFHack {
+	namespace Items {
+		// getPosition: the position of <item>, or of whatever holds it
+		df::coord getPosition(df::item* item);
+		bool getContainedItems(df::item* item, std::vector<df::item*>* items);
+		// moveToContainer: takes <item> off the ground and puts it inside <container>; only items on the ground are supported
+		bool moveToContainer(MapExtras::MapCache& mc, df::item* item, df::item* container);
+	}
+}
@@ -0,0 +1,13 @@
+// Stand-in for modules/MapCache.h: offline, items are moved straight in the stand-in map, so there is nothing to write back
+#pragma once
+
+#include "df/item.h"
+
+namespace MapExtras {
+	class MapCache {
+		public:
+			bool addItemOnGround(df::item* item);
+			bool removeItemOnGround(df::item* item);
+			bool WriteAll() { return true; }
+	};
+}
@@ -0,0 +1,15 @@
+// Stand-in for modules/Materials.h
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace DFHack {
+	struct MaterialInfo {
+		int16_t type = -1;
+		int32_t index = -1;
+
+		// find: by token; only those the offline target uses are known
+		bool find(const std::string& token);
+	};
+}
@@ -0,0 +1,11 @@
+// Stand-in for modules/Units.h
+#pragma once
+
+#include "df/coord.h"
+#include "df/unit.h"
+
+namespace DFHack {
+	namespace Units {
+		df::coord getPosition(df::unit* unit);
+	}
+}
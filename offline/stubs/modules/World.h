@@ -0,0 +1,27 @@
+// Stand-in for modules/World.h: the persistent data is kept in memory for the life of the process
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace DFHack {
+	class PersistentDataItem {
+		public:
+			PersistentDataItem() : value(nullptr) {}
+			PersistentDataItem(const std::string& key, std::string* value) : key_(key), value(value) {}
+
+			bool isValid() const { return value != nullptr; }
+			const std::string& key() const { return key_; }
+			std::string& val() { return *value; }
+		private:
+			std::string key_;
+			std::string* value;
+	};
+
+	namespace World {
+		PersistentDataItem GetPersistentData(const std::string& key);
+		PersistentDataItem AddPersistentData(const std::string& key);
+		void GetPersistentData(std::vector<PersistentDataItem>* vec, const std::string& key, bool prefix = false);
+		bool DeletePersistentData(const PersistentDataItem& item);
+	}
+}